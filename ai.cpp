@@ -0,0 +1,207 @@
+#include <iostream>
+#include <SDL2/SDL.h>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "helpers.h"
+#include "ai.h"
+#include "entities.h"
+#include "los.h"
+#include "proximity.h"
+#include "path.h"
+#include "movers.h"
+#include "profiler.h"
+#include "render.h"
+#include "audio.h"
+
+using namespace std;
+
+const double AI_NEAR_DISTANCE = 8.0;  // priority halves at this distance from the player
+const double AI_VISIBLE_WEIGHT = 4.0; // monsters that saw the player think this much more often
+const double AI_SIGHT_RANGE = 24.0;
+const double AI_EYE_HEIGHT = 1.0;
+const double AI_ARRIVE_DISTANCE = 0.5;
+const double MONSTER_CHASE_SPEED = 2.5;
+const int AI_FLOW_SECTORS_PER_TICK = 256;
+const int AI_SIGHT_BATCH = 8; // thinks taken off the queue per budget check
+const double AI_CALL_RADIUS = 12.0; // a monster that spots the player alerts ones it can see this close
+const int AI_CALL_COUNT = 4;
+
+int aiFixedThinks = 0;
+
+static Uint32 aiTick = 0;
+static FlowField playerField; // shared by every monster chasing the player
+
+struct ThinkCandidate {
+    double priority;
+    int entity;
+
+    // Max-heap order; equal priorities go to the lower index for repeatable runs
+    bool operator<(const ThinkCandidate& other) const {
+        return priority < other.priority || (priority == other.priority && entity > other.entity);
+    }
+};
+
+void aiReset() {
+    aiTick = 0;
+    playerField = FlowField();
+}
+
+// False if the monster can't see the player whatever lies between them
+static bool sightQuery(int e, int playerSector, double playerZ, LosQuery& q) {
+    int sector = entities.sector[e];
+    double x = entities.posX[e], y = entities.posY[e];
+    double dx = posX - x, dy = posY - y;
+    if (sector < 0 || playerSector < 0 || dx * dx + dy * dy >= AI_SIGHT_RANGE * AI_SIGHT_RANGE) return false;
+    q = { sector, x, y, sectors[sector].floorHeight + AI_EYE_HEIGHT, playerSector, posX, posY, playerZ };
+    return true;
+}
+
+// False unless the monster is alerted and not there yet
+static bool alertPathRequest(int e, PathRequest& request) {
+    int sector = entities.sector[e];
+    double x = entities.posX[e], y = entities.posY[e];
+    double ax = entities.alertX[e], ay = entities.alertY[e];
+    if (sector < 0 || !(entities.flags[e] & ENTITY_ALERTED) || hypot(ax - x, ay - y) < AI_ARRIVE_DISTANCE) return false;
+    request = { sector, x, y, getSectorForFeet(ax, ay, sectors[sector].floorHeight), ax, ay };
+    return true;
+}
+
+// The nearest few monsters in sight of e go and look where it saw the player
+static void callOut(int e) {
+    int sector = entities.sector[e];
+    RadiusQuery q = { sector, entities.posX[e], entities.posY[e], sectors[sector].floorHeight + AI_EYE_HEIGHT,
+                      AI_CALL_RADIUS, ENTITY_MONSTER, true };
+    static vector<EntityNear> heard;
+    queryNearestEntities(q, AI_CALL_COUNT + 1, heard);
+    for (const EntityNear& n : heard) {
+        if (n.entity == e || (entities.flags[n.entity] & ENTITY_SEES_PLAYER)) continue;
+        entities.flags[n.entity] |= ENTITY_ALERTED;
+        entities.alertX[n.entity] = entities.alertX[e];
+        entities.alertY[n.entity] = entities.alertY[e];
+    }
+}
+
+// alertPath is the route to the alert spot, or null if there is none to
+// follow. True if the monster has just spotted the player.
+static bool think(int e, bool sees, const Path* alertPath) {
+    Uint32& flags = entities.flags[e];
+    int sector = entities.sector[e];
+    double x = entities.posX[e], y = entities.posY[e];
+    if (sector < 0) return false;
+    bool spotted = sees && !(flags & ENTITY_SEES_PLAYER);
+
+    double targetX = 0.0, targetY = 0.0;
+    bool haveTarget = false;
+    if (sees) {
+        if (spotted) playSound(SOUND_GROWL, sector, x, y, 0.7);
+        flags |= ENTITY_SEES_PLAYER | ENTITY_ALERTED;
+        entities.alertX[e] = posX;
+        entities.alertY[e] = posY;
+        haveTarget = flowFieldTarget(playerField, sector, x, y, targetX, targetY);
+    } else {
+        flags &= ~ENTITY_SEES_PLAYER;
+        if (flags & ENTITY_ALERTED) {
+            // Go and look where the noise or last sighting was, then give up
+            if (alertPath && alertPath->found && alertPath->points.size() >= 2) {
+                targetX = alertPath->points[1].x;
+                targetY = alertPath->points[1].y;
+                haveTarget = true;
+            } else {
+                flags &= ~ENTITY_ALERTED;
+            }
+        }
+    }
+
+    // Without a target keep wandering on the current velocity
+    if (!haveTarget) return spotted;
+    double tx = targetX - x, ty = targetY - y;
+    double length = sqrt(tx * tx + ty * ty);
+    if (length < 1e-9) return spotted;
+    entities.velX[e] = tx / length * MONSTER_CHASE_SPEED;
+    entities.velY[e] = ty / length * MONSTER_CHASE_SPEED;
+    return spotted;
+}
+
+void aiUpdate(double budgetMicroseconds) {
+    aiTick++;
+
+    int playerSector = getSectorForFeet(posX, posY, posZ);
+    double playerZ = playerSector >= 0 ? sectors[playerSector].floorHeight + playerEyeHeightOffset : 0.0;
+    if (playerSector >= 0) flowFieldSetGoal(playerField, playerSector, posX, posY);
+    for (int s : changedSectors) flowFieldInvalidateSector(playerField, s);
+    flowFieldUpdate(playerField, AI_FLOW_SECTORS_PER_TICK);
+
+    static vector<ThinkCandidate> queue;
+    queue.clear();
+    for (int e = 0; e < entities.count(); e++) {
+        if (!(entities.flags[e] & ENTITY_MONSTER)) continue;
+        double dx = posX - entities.posX[e], dy = posY - entities.posY[e];
+        double weight = 1.0 / (1.0 + sqrt(dx * dx + dy * dy) / AI_NEAR_DISTANCE);
+        if (entities.flags[e] & ENTITY_SEES_PLAYER) weight *= AI_VISIBLE_WEIGHT;
+        queue.push_back({ (double)(aiTick - entities.thinkTick[e]) * weight, e });
+    }
+    make_heap(queue.begin(), queue.end());
+
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    Uint64 budget = (Uint64)(budgetMicroseconds * freq / 1e6);
+    Uint64 start = SDL_GetPerformanceCounter();
+    int thought = 0;
+    static vector<int> batch, sightIndex, pathIndex, spotters;
+    static vector<LosQuery> sightQueries;
+    static vector<Uint8> visible;
+    static vector<PathRequest> pathRequests;
+    static vector<Path> paths;
+    while (!queue.empty()) {
+        if (aiFixedThinks > 0 ? thought >= aiFixedThinks : SDL_GetPerformanceCounter() - start >= budget) break;
+
+        // Thinks don't move anyone, so a few can have their sight checked and
+        // routes found in one batch each up front
+        int take = aiFixedThinks > 0 ? min(AI_SIGHT_BATCH, aiFixedThinks - thought) : AI_SIGHT_BATCH;
+        batch.clear();
+        sightIndex.clear();
+        sightQueries.clear();
+        while ((int)batch.size() < take && !queue.empty()) {
+            pop_heap(queue.begin(), queue.end());
+            int e = queue.back().entity;
+            queue.pop_back();
+            LosQuery q;
+            sightIndex.push_back(sightQuery(e, playerSector, playerZ, q) ? (int)sightQueries.size() : -1);
+            if (sightIndex.back() >= 0) sightQueries.push_back(q);
+            batch.push_back(e);
+        }
+        visible.resize(sightQueries.size());
+        checkLinesOfSight(sightQueries.data(), (int)sightQueries.size(), visible.data());
+
+        pathIndex.clear();
+        pathRequests.clear();
+        for (int k = 0; k < (int)batch.size(); k++) {
+            bool sees = sightIndex[k] >= 0 && visible[sightIndex[k]];
+            PathRequest request;
+            pathIndex.push_back(!sees && alertPathRequest(batch[k], request) ? (int)pathRequests.size() : -1);
+            if (pathIndex.back() >= 0) pathRequests.push_back(request);
+        }
+        paths.resize(pathRequests.size());
+        findPaths(pathRequests.data(), (int)pathRequests.size(), paths.data());
+
+        spotters.clear();
+        for (int k = 0; k < (int)batch.size(); k++) {
+            bool sees = sightIndex[k] >= 0 && visible[sightIndex[k]];
+            if (think(batch[k], sees, pathIndex[k] >= 0 ? &paths[pathIndex[k]] : nullptr)) spotters.push_back(batch[k]);
+            entities.thinkTick[batch[k]] = aiTick;
+            thought++;
+        }
+        // After the batch, so no one thinks with a route planned before they were called
+        for (int e : spotters) callOut(e);
+    }
+
+    if (profilerEnabled) {
+        // A think can't be cut short, so the last one may run past the budget
+        double usedUs = (double)(SDL_GetPerformanceCounter() - start) * 1e6 / freq;
+        profilerRecord("ai_budget_us", budgetMicroseconds);
+        profilerRecord("ai_used_us", usedUs);
+        profilerRecord("ai_overrun_us", max(0.0, usedUs - budgetMicroseconds));
+        profilerRecord("ai_thinks", thought);
+        profilerRecord("ai_queue_depth", (double)queue.size());
+    }
+}
@@ -0,0 +1,20 @@
+// ai.h
+#ifndef AI_H
+#define AI_H
+
+// Monster thinking, spread over ticks. Every tick each monster's priority
+// grows with the ticks since it last thought, weighted up when it is near
+// the player or saw them last time; the highest priorities think first
+// until the budget is spent. Wandering monsters keep their velocity
+// between thinks, so skipping one only delays a decision.
+const double AI_BUDGET_US = 500.0;
+const int AI_DEMO_THINKS = 64;
+
+// > 0: think exactly this many monsters per tick instead of timing the
+// budget, so demo playback doesn't depend on machine speed.
+extern int aiFixedThinks;
+
+void aiReset();
+void aiUpdate(double budgetMicroseconds);
+
+#endif
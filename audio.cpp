@@ -0,0 +1,261 @@
+#include <iostream>
+#include <SDL2/SDL.h>
+#include <vector>
+#include <cmath>
+#include <atomic>
+#include <limits>
+#include <random>
+#include <cstring>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "helpers.h"
+#include "audio.h"
+#include "path.h"
+#include "profiler.h"
+
+using namespace std;
+
+struct AudioCommand {
+    int sound;
+    float gainL, gainR;
+};
+
+struct Voice {
+    const float* samples = nullptr;
+    int length = 0;
+    int position = 0;
+    float gainL = 0.0f, gainR = 0.0f;
+};
+
+static SDL_AudioDeviceID audioDevice = 0;
+static int sampleRate = AUDIO_SAMPLE_RATE;
+static vector<float> soundData[SOUND_COUNT]; // mono, written before the device starts
+
+// Producer owns queueTail, the callback owns queueHead
+static AudioCommand commandQueue[AUDIO_QUEUE_SIZE];
+static atomic<unsigned> queueHead(0), queueTail(0);
+
+static Voice voices[AUDIO_MAX_VOICES]; // audio thread only
+
+// Written by the callback, drained by audioPublishStats
+static atomic<Uint64> statTicks(0), statVoiceTicks(0), statCallbacks(0), statVoiceMixes(0), statDropped(0);
+
+static void generateSounds() {
+    minstd_rand rng(7);
+    uniform_real_distribution<float> noise(-1.0f, 1.0f);
+    const double pi = 3.14159265358979323846;
+    auto make = [&](int sound, double seconds) -> vector<float>& {
+        soundData[sound].assign((size_t)(seconds * sampleRate), 0.0f);
+        return soundData[sound];
+    };
+
+    // Noise burst over a low thump
+    vector<float>& shot = make(SOUND_SHOTGUN, 0.4);
+    for (size_t i = 0; i < shot.size(); i++) {
+        double t = (double)i / sampleRate;
+        shot[i] = (float)(0.7 * noise(rng) * exp(-t * 12.0) + 0.5 * sin(2.0 * pi * 55.0 * t) * exp(-t * 18.0));
+    }
+
+    vector<float>& impact = make(SOUND_IMPACT, 0.08);
+    for (size_t i = 0; i < impact.size(); i++) {
+        double t = (double)i / sampleRate;
+        impact[i] = (float)(0.6 * noise(rng) * exp(-t * 60.0));
+    }
+
+    // Low-passed rumble that fades in and out
+    vector<float>& door = make(SOUND_DOOR, 1.0);
+    float smooth = 0.0f;
+    for (size_t i = 0; i < door.size(); i++) {
+        double t = (double)i / sampleRate;
+        smooth += (noise(rng) - smooth) * 0.02f;
+        double envelope = min(1.0, t * 10.0) * min(1.0, (1.0 - t) * 5.0);
+        door[i] = (float)(envelope * (0.4 * sin(2.0 * pi * 40.0 * t) + 2.0 * smooth));
+    }
+
+    // Sawtooth with a wobbling pitch
+    vector<float>& growl = make(SOUND_GROWL, 0.6);
+    double phase = 0.0;
+    for (size_t i = 0; i < growl.size(); i++) {
+        double t = (double)i / sampleRate;
+        phase += (90.0 + 15.0 * sin(2.0 * pi * 7.0 * t)) / sampleRate;
+        double envelope = min(1.0, t * 20.0) * exp(-t * 3.0);
+        growl[i] = (float)(envelope * 0.5 * (2.0 * (phase - floor(phase)) - 1.0));
+    }
+}
+
+static void startVoice(const AudioCommand& command) {
+    // A free voice, else steal the one nearest its end
+    int slot = 0, bestLeft = numeric_limits<int>::max();
+    for (int v = 0; v < AUDIO_MAX_VOICES; v++) {
+        if (!voices[v].samples) {
+            slot = v;
+            break;
+        }
+        int left = voices[v].length - voices[v].position;
+        if (left < bestLeft) {
+            bestLeft = left;
+            slot = v;
+        }
+    }
+    if (voices[slot].samples) statDropped.fetch_add(1, memory_order_relaxed);
+    Voice& voice = voices[slot];
+    voice.samples = soundData[command.sound].data();
+    voice.length = (int)soundData[command.sound].size();
+    voice.position = 0;
+    voice.gainL = command.gainL;
+    voice.gainR = command.gainR;
+}
+
+// Adds a mono run into interleaved stereo
+static void mixVoice(float* out, const float* in, int frames, float gainL, float gainR) {
+    int i = 0;
+#ifdef __SSE2__
+    __m128 gl = _mm_set1_ps(gainL), gr = _mm_set1_ps(gainR);
+    for (; i + 3 < frames; i += 4) {
+        __m128 s = _mm_loadu_ps(in + i);
+        __m128 l = _mm_mul_ps(s, gl), r = _mm_mul_ps(s, gr);
+        float* o = out + 2 * i;
+        _mm_storeu_ps(o, _mm_add_ps(_mm_loadu_ps(o), _mm_unpacklo_ps(l, r)));
+        _mm_storeu_ps(o + 4, _mm_add_ps(_mm_loadu_ps(o + 4), _mm_unpackhi_ps(l, r)));
+    }
+#endif
+    for (; i < frames; i++) {
+        out[2 * i] += in[i] * gainL;
+        out[2 * i + 1] += in[i] * gainR;
+    }
+}
+
+static void clampOutput(float* out, int count) {
+    int i = 0;
+#ifdef __SSE2__
+    __m128 lo = _mm_set1_ps(-1.0f), hi = _mm_set1_ps(1.0f);
+    for (; i + 3 < count; i += 4) {
+        _mm_storeu_ps(out + i, _mm_min_ps(hi, _mm_max_ps(lo, _mm_loadu_ps(out + i))));
+    }
+#endif
+    for (; i < count; i++) out[i] = min(1.0f, max(-1.0f, out[i]));
+}
+
+static void audioCallback(void*, Uint8* stream, int len) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    float* out = (float*)stream;
+    int frames = len / (int)(2 * sizeof(float));
+    memset(stream, 0, len);
+
+    unsigned head = queueHead.load(memory_order_relaxed);
+    unsigned tail = queueTail.load(memory_order_acquire);
+    for (; head != tail; head++) startVoice(commandQueue[head & (AUDIO_QUEUE_SIZE - 1)]);
+    queueHead.store(head, memory_order_release);
+
+    Uint64 mixed = 0;
+    Uint64 voiceStart = SDL_GetPerformanceCounter();
+    for (Voice& voice : voices) {
+        if (!voice.samples) continue;
+        int n = min(frames, voice.length - voice.position);
+        mixVoice(out, voice.samples + voice.position, n, voice.gainL, voice.gainR);
+        voice.position += n;
+        if (voice.position >= voice.length) voice.samples = nullptr;
+        mixed++;
+    }
+    Uint64 voiceEnd = SDL_GetPerformanceCounter();
+    clampOutput(out, frames * 2);
+
+    statVoiceTicks.fetch_add(voiceEnd - voiceStart, memory_order_relaxed);
+    statTicks.fetch_add(SDL_GetPerformanceCounter() - start, memory_order_relaxed);
+    statCallbacks.fetch_add(1, memory_order_relaxed);
+    statVoiceMixes.fetch_add(mixed, memory_order_relaxed);
+}
+
+bool audioInit() {
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+        cerr << "Audio unavailable: " << SDL_GetError() << endl;
+        return false;
+    }
+    SDL_AudioSpec want, have;
+    memset(&want, 0, sizeof(want));
+    want.freq = AUDIO_SAMPLE_RATE;
+    want.format = AUDIO_F32SYS;
+    want.channels = 2;
+    want.samples = AUDIO_BUFFER_FRAMES;
+    want.callback = audioCallback;
+    audioDevice = SDL_OpenAudioDevice(NULL, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if (audioDevice == 0) {
+        cerr << "Could not open audio device: " << SDL_GetError() << endl;
+        return false;
+    }
+    sampleRate = have.freq;
+    generateSounds();
+    SDL_PauseAudioDevice(audioDevice, 0);
+    return true;
+}
+
+void audioShutdown() {
+    if (audioDevice == 0) return;
+    SDL_CloseAudioDevice(audioDevice);
+    audioDevice = 0;
+}
+
+// Path length from the player to the source and the direction of the
+// first corner on the way; straight line when no route is open.
+static bool listenerPath(int sector, double x, double y, double& dist, double& toX, double& toY) {
+    int playerSector = getSectorForFeet(posX, posY, posZ);
+    toX = x - posX;
+    toY = y - posY;
+    dist = sqrt(toX * toX + toY * toY);
+    if (playerSector < 0 || sector < 0) return false;
+    if (playerSector == sector) return true;
+
+    PathRequest request = { playerSector, posX, posY, sector, x, y };
+    Path path;
+    if (!findPath(request, path) || path.points.size() < 2) return false;
+    dist = 0.0;
+    for (size_t i = 1; i < path.points.size(); i++) {
+        dist += hypot(path.points[i].x - path.points[i - 1].x, path.points[i].y - path.points[i - 1].y);
+    }
+    toX = path.points[1].x - posX;
+    toY = path.points[1].y - posY;
+    return true;
+}
+
+void playSound(int sound, int sector, double x, double y, double volume) {
+    if (audioDevice == 0 || sound < 0 || sound >= SOUND_COUNT) return;
+
+    double dist, toX, toY;
+    bool open = listenerPath(sector, x, y, dist, toX, toY);
+    if (dist > AUDIO_MAX_DISTANCE) return;
+    double gain = volume / (1.0 + dist / AUDIO_REFERENCE_DISTANCE);
+    if (!open) gain *= AUDIO_OCCLUDED_GAIN;
+
+    // Equal-power pan against the camera plane, which points right
+    double pan = 0.0;
+    double toLength = sqrt(toX * toX + toY * toY);
+    double planeLength = sqrt(planeX * planeX + planeY * planeY);
+    if (toLength > 1e-6 && planeLength > 1e-6) pan = (toX * planeX + toY * planeY) / (toLength * planeLength);
+    double angle = (pan + 1.0) * 0.25 * 3.14159265358979323846;
+
+    unsigned tail = queueTail.load(memory_order_relaxed);
+    if (tail - queueHead.load(memory_order_acquire) >= (unsigned)AUDIO_QUEUE_SIZE) {
+        statDropped.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    commandQueue[tail & (AUDIO_QUEUE_SIZE - 1)] = { sound, (float)(gain * cos(angle)), (float)(gain * sin(angle)) };
+    queueTail.store(tail + 1, memory_order_release);
+}
+
+void audioPublishStats() {
+    if (audioDevice == 0) return;
+    Uint64 ticks = statTicks.exchange(0, memory_order_relaxed);
+    Uint64 voiceTicks = statVoiceTicks.exchange(0, memory_order_relaxed);
+    Uint64 callbacks = statCallbacks.exchange(0, memory_order_relaxed);
+    Uint64 mixes = statVoiceMixes.exchange(0, memory_order_relaxed);
+    Uint64 dropped = statDropped.exchange(0, memory_order_relaxed);
+    if (callbacks == 0) return;
+
+    double freq = (double)SDL_GetPerformanceFrequency();
+    profilerRecord("audio_callback_us", ticks * 1e6 / freq / callbacks);
+    profilerRecord("audio_voices", (double)mixes / callbacks);
+    if (mixes > 0) profilerRecord("audio_us_per_voice", voiceTicks * 1e6 / freq / mixes);
+    profilerRecord("audio_dropped", (double)dropped);
+}
@@ -0,0 +1,38 @@
+// audio.h
+#ifndef AUDIO_H
+#define AUDIO_H
+
+// Software mixer on the SDL audio callback. The simulation pushes play
+// commands through a single-producer/single-consumer ring; the callback
+// drains it and mixes every active voice into float stereo. Nothing on
+// the audio thread allocates or takes a lock.
+const int AUDIO_MAX_VOICES = 64;
+const int AUDIO_SAMPLE_RATE = 44100;
+const int AUDIO_BUFFER_FRAMES = 512;
+const int AUDIO_QUEUE_SIZE = 256; // power of two
+const double AUDIO_REFERENCE_DISTANCE = 4.0; // gain halves at this path length
+const double AUDIO_MAX_DISTANCE = 64.0;
+const double AUDIO_OCCLUDED_GAIN = 0.25;     // no open route: heard through the walls
+
+// Procedural sounds, generated once when the device opens
+enum {
+    SOUND_SHOTGUN = 0,
+    SOUND_IMPACT = 1,
+    SOUND_DOOR = 2,
+    SOUND_GROWL = 3,
+    SOUND_COUNT
+};
+
+// False if no device could be opened; playSound is then a no-op.
+bool audioInit();
+void audioShutdown();
+
+// Distance and pan come from the portal path between the player and the
+// source, so a sound around a corner pans toward the doorway it comes through.
+void playSound(int sound, int sector, double x, double y, double volume);
+
+// Forwards the mixer's timings since the last call to the profiler.
+// Call from the main thread.
+void audioPublishStats();
+
+#endif
@@ -0,0 +1,379 @@
+#include <iostream>
+#include <SDL2/SDL.h>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "helpers.h"
+#include "collision.h"
+#include "jobs.h"
+#include "polyobj.h"
+
+using namespace std;
+
+CollisionGrid collisionGrid;
+
+const int QUERY_GRAIN = 512;
+
+// Flattened wall table indexed by global wall id
+struct GridWall {
+    double x1, y1, dx, dy, invLength2;
+    bool blocks;
+};
+static vector<GridWall> gridWalls;
+
+// Padded cell range each wall was inserted into, so a moved wall can be
+// taken out of exactly those cells. Empty (x0 > x1) if not in the grid.
+struct CellRange {
+    int x0, y0, x1, y1;
+};
+static vector<CellRange> wallCells;
+static vector<CellRange> sectorCells; // cells whose sector list holds each sector
+
+// Cell sector lists run by floor height so getSectorForPosition can binary
+// search the level; equal floors keep the lower index nearer the top.
+static bool lowerFloor(int a, int b) {
+    double fa = sectors[a].floorHeight, fb = sectors[b].floorHeight;
+    return fa < fb || (fa == fb && a > b);
+}
+
+static CellRange paddedCellRange(const Wall& wall) {
+    const CollisionGrid& grid = collisionGrid;
+    CellRange r;
+    r.x0 = max(0, (int)((min(wall.x1, wall.x2) - GRID_QUERY_PAD - grid.originX) / GRID_CELL_SIZE));
+    r.y0 = max(0, (int)((min(wall.y1, wall.y2) - GRID_QUERY_PAD - grid.originY) / GRID_CELL_SIZE));
+    r.x1 = min(grid.width - 1, (int)((max(wall.x1, wall.x2) + GRID_QUERY_PAD - grid.originX) / GRID_CELL_SIZE));
+    r.y1 = min(grid.height - 1, (int)((max(wall.y1, wall.y2) + GRID_QUERY_PAD - grid.originY) / GRID_CELL_SIZE));
+    return r;
+}
+
+static void insertWallCells(int id, const CellRange& r) {
+    for (int cy = r.y0; cy <= r.y1; cy++) {
+        for (int cx = r.x0; cx <= r.x1; cx++) {
+            collisionGrid.cellWalls[cy * collisionGrid.width + cx].push_back(id);
+        }
+    }
+    wallCells[id] = r;
+}
+
+void buildCollisionGrid() {
+    CollisionGrid& grid = collisionGrid;
+    grid = CollisionGrid();
+    gridWalls.clear();
+    wallCells.clear();
+    sectorCells.assign(sectors.size(), { 0, 0, -1, -1 });
+
+    double minX = 1e30, minY = 1e30, maxX = -1e30, maxY = -1e30;
+    for (int s = 0; s < (int)sectors.size(); s++) {
+        grid.sectorWallBase.push_back((int)gridWalls.size());
+        grid.wallSector.insert(grid.wallSector.end(), sectors[s].walls.size(), s);
+        for (const Wall& wall : sectors[s].walls) {
+            double dx = wall.x2 - wall.x1, dy = wall.y2 - wall.y1;
+            double length2 = dx * dx + dy * dy;
+            gridWalls.push_back({ wall.x1, wall.y1, dx, dy, length2 > 0.0 ? 1.0 / length2 : 0.0,
+                                  wallBlocksMovement(s, wall) });
+            minX = min(minX, min(wall.x1, wall.x2));
+            maxX = max(maxX, max(wall.x1, wall.x2));
+            minY = min(minY, min(wall.y1, wall.y2));
+            maxY = max(maxY, max(wall.y1, wall.y2));
+        }
+    }
+    grid.sectorWallBase.push_back((int)gridWalls.size());
+    wallCells.assign(gridWalls.size(), { 0, 0, -1, -1 });
+    if (gridWalls.empty()) return;
+    polyobjSweptBounds(minX, minY, maxX, maxY);
+
+    grid.originX = minX - GRID_QUERY_PAD;
+    grid.originY = minY - GRID_QUERY_PAD;
+    grid.width = (int)((maxX + GRID_QUERY_PAD - grid.originX) / GRID_CELL_SIZE) + 1;
+    grid.height = (int)((maxY + GRID_QUERY_PAD - grid.originY) / GRID_CELL_SIZE) + 1;
+    grid.cellWalls.assign(grid.width * grid.height, vector<int>());
+    grid.cellSectors.assign(grid.width * grid.height, vector<int>());
+
+    auto cellRange = [&](double x0, double y0, double x1, double y1, int& cx0, int& cy0, int& cx1, int& cy1) {
+        cx0 = max(0, (int)((x0 - grid.originX) / GRID_CELL_SIZE));
+        cy0 = max(0, (int)((y0 - grid.originY) / GRID_CELL_SIZE));
+        cx1 = min(grid.width - 1, (int)((x1 - grid.originX) / GRID_CELL_SIZE));
+        cy1 = min(grid.height - 1, (int)((y1 - grid.originY) / GRID_CELL_SIZE));
+    };
+
+    for (int s = 0; s < (int)sectors.size(); s++) {
+        const Sector& sector = sectors[s];
+        if (sector.walls.empty()) continue;
+        double sx0 = 1e30, sy0 = 1e30, sx1 = -1e30, sy1 = -1e30;
+        for (int w = 0; w < (int)sector.walls.size(); w++) {
+            const Wall& wall = sector.walls[w];
+            if (wallOnOutline(wall)) {
+                sx0 = min(sx0, min(wall.x1, wall.x2));
+                sx1 = max(sx1, max(wall.x1, wall.x2));
+                sy0 = min(sy0, min(wall.y1, wall.y2));
+                sy1 = max(sy1, max(wall.y1, wall.y2));
+            }
+            int n = wall.adjoiningSector;
+            if (wall.isPortal && (n < 0 || n >= (int)sectors.size())) continue; // can never block
+
+            insertWallCells(grid.sectorWallBase[s] + w, paddedCellRange(wall));
+        }
+
+        int cx0, cy0, cx1, cy1;
+        cellRange(sx0, sy0, sx1, sy1, cx0, cy0, cx1, cy1);
+        for (int cy = cy0; cy <= cy1; cy++) {
+            for (int cx = cx0; cx <= cx1; cx++) {
+                grid.cellSectors[cy * grid.width + cx].push_back(s);
+            }
+        }
+        sectorCells[s] = { cx0, cy0, cx1, cy1 };
+    }
+    for (vector<int>& cell : grid.cellSectors) sort(cell.begin(), cell.end(), lowerFloor);
+}
+
+// A sector's planes moved: only its own portals and the matching portals
+// of its neighbours can have changed, plus its place in the floor order of
+// the cells it covers.
+void collisionRefreshSector(int sector) {
+    CollisionGrid& grid = collisionGrid;
+    if (sector < 0 || sector + 1 >= (int)grid.sectorWallBase.size()) return;
+    const CellRange& cells = sectorCells[sector];
+    for (int cy = cells.y0; cy <= cells.y1; cy++) {
+        for (int cx = cells.x0; cx <= cells.x1; cx++) {
+            // One entry moved, so an insertion pass restores the order
+            vector<int>& list = grid.cellSectors[cy * grid.width + cx];
+            for (size_t i = 1; i < list.size(); i++) {
+                for (size_t j = i; j > 0 && lowerFloor(list[j], list[j - 1]); j--) swap(list[j], list[j - 1]);
+            }
+        }
+    }
+
+    const vector<Wall>& walls = sectors[sector].walls;
+    for (int w = 0; w < (int)walls.size(); w++) {
+        const Wall& wall = walls[w];
+        int n = wall.adjoiningSector;
+        if (!wall.isPortal || n < 0 || n >= (int)sectors.size()) continue;
+        gridWalls[grid.sectorWallBase[sector] + w].blocks = wallBlocksMovement(sector, wall);
+        for (int b = 0; b < (int)sectors[n].walls.size(); b++) {
+            const Wall& back = sectors[n].walls[b];
+            if (back.isPortal && back.adjoiningSector == sector) {
+                gridWalls[grid.sectorWallBase[n] + b].blocks = wallBlocksMovement(n, back);
+            }
+        }
+    }
+}
+
+// Refit after a wall's endpoints changed. The cells it covers are only
+// rewritten when its padded cell range actually changed, which for a
+// small per-tick move is rare.
+void collisionRefitWall(int sector, int wallIndex) {
+    CollisionGrid& grid = collisionGrid;
+    if (sector < 0 || sector + 1 >= (int)grid.sectorWallBase.size()) return;
+    int id = grid.sectorWallBase[sector] + wallIndex;
+    if (id >= grid.sectorWallBase[sector + 1]) return;
+
+    const Wall& wall = sectors[sector].walls[wallIndex];
+    GridWall& gw = gridWalls[id];
+    double dx = wall.x2 - wall.x1, dy = wall.y2 - wall.y1;
+    double length2 = dx * dx + dy * dy;
+    gw.x1 = wall.x1;
+    gw.y1 = wall.y1;
+    gw.dx = dx;
+    gw.dy = dy;
+    gw.invLength2 = length2 > 0.0 ? 1.0 / length2 : 0.0;
+
+    CellRange old = wallCells[id];
+    CellRange r = paddedCellRange(wall);
+    if (old.x0 == r.x0 && old.y0 == r.y0 && old.x1 == r.x1 && old.y1 == r.y1) return;
+    for (int cy = old.y0; cy <= old.y1; cy++) {
+        for (int cx = old.x0; cx <= old.x1; cx++) {
+            vector<int>& cell = grid.cellWalls[cy * grid.width + cx];
+            for (size_t k = 0; k < cell.size(); k++) {
+                if (cell[k] != id) continue;
+                cell[k] = cell.back();
+                cell.pop_back();
+                break;
+            }
+        }
+    }
+    insertWallCells(id, r);
+}
+
+int gridCellForPosition(double x, double y) {
+    const CollisionGrid& grid = collisionGrid;
+    double fx = (x - grid.originX) / GRID_CELL_SIZE;
+    double fy = (y - grid.originY) / GRID_CELL_SIZE;
+    if (!(fx >= 0.0 && fy >= 0.0)) return -1;
+    int cx = (int)fx, cy = (int)fy;
+    if (cx >= grid.width || cy >= grid.height) return -1;
+    return cy * grid.width + cx;
+}
+
+// Sorted copy of a batch. order[i] is the caller's index for sorted slot i.
+struct SortedQueries {
+    vector<int> cell, order;
+    vector<double> x, y, z, radius2;
+};
+
+static void sortQueriesByCell(const double* xs, const double* ys, const double* zs, const double* radii, int count,
+                              SortedQueries& q) {
+    int cellCount = collisionGrid.width * collisionGrid.height;
+    vector<int> keys(count);
+    vector<int> start(cellCount + 2, 0);
+    for (int i = 0; i < count; i++) {
+        keys[i] = gridCellForPosition(xs[i], ys[i]) + 1; // bucket 0 collects outside queries
+        start[keys[i] + 1]++;
+    }
+    for (int c = 0; c <= cellCount; c++) start[c + 1] += start[c];
+
+    q.cell.resize(count);
+    q.order.resize(count);
+    q.x.resize(count);
+    q.y.resize(count);
+    q.z.resize(count);
+    q.radius2.resize(radii ? count : 0);
+    for (int i = 0; i < count; i++) {
+        int slot = start[keys[i]]++;
+        q.cell[slot] = keys[i] - 1;
+        q.order[slot] = i;
+        q.x[slot] = xs[i];
+        q.y[slot] = ys[i];
+        q.z[slot] = zs ? zs[i] : INFINITY;
+        if (radii) q.radius2[slot] = radii[i] * radii[i];
+    }
+}
+
+// Calls body(cell, first, last) for every run of equal cells in the chunks
+static void forEachCellRun(const SortedQueries& q, int count, void (*body)(const SortedQueries&, int, int, int, void*), void* out) {
+    parallelFor(0, count, QUERY_GRAIN, [&](int first, int last) {
+        int i = first;
+        while (i < last) {
+            int j = i + 1;
+            while (j < last && q.cell[j] == q.cell[i]) j++;
+            body(q, q.cell[i], i, j, out);
+            i = j;
+        }
+    });
+}
+
+// Same pick as getSectorForPosition: the highest floor at or below z, else
+// the lowest above it. Candidates run up by floor with the lower index
+// last among equal floors, so the last one below and the first one above
+// win, as in the scalar walk.
+static void sectorRun(const SortedQueries& q, int cell, int first, int last, void* out) {
+    int* result = (int*)out;
+    if (cell < 0) {
+        for (int i = first; i < last; i++) result[q.order[i]] = -1;
+        return;
+    }
+
+    const vector<int>& candidates = collisionGrid.cellSectors[cell];
+    int i = first;
+#ifdef __SSE2__
+    const __m128d epsilon = _mm_set1_pd(1e-10);
+    for (; i + 1 < last; i += 2) {
+        __m128d px = _mm_loadu_pd(&q.x[i]);
+        __m128d py = _mm_loadu_pd(&q.y[i]);
+        int below[2] = { -1, -1 }, above[2] = { -1, -1 };
+
+        for (int s : candidates) {
+            __m128d inside = _mm_setzero_pd();
+            for (const Wall& wall : sectors[s].walls) {
+                if (!wallOnOutline(wall)) continue;
+                __m128d x1 = _mm_set1_pd(wall.x1), y1 = _mm_set1_pd(wall.y1);
+                __m128d x2 = _mm_set1_pd(wall.x2), y2 = _mm_set1_pd(wall.y2);
+                __m128d straddles = _mm_xor_pd(_mm_cmpgt_pd(y1, py), _mm_cmpgt_pd(y2, py));
+                __m128d edgeX = _mm_add_pd(_mm_div_pd(_mm_mul_pd(_mm_sub_pd(x2, x1), _mm_sub_pd(py, y1)),
+                                                      _mm_add_pd(_mm_sub_pd(y2, y1), epsilon)), x1);
+                inside = _mm_xor_pd(inside, _mm_and_pd(straddles, _mm_cmplt_pd(px, edgeX)));
+            }
+            int mask = _mm_movemask_pd(inside);
+            for (int lane = 0; lane < 2; lane++) {
+                if (!(mask & (1 << lane))) continue;
+                if (sectors[s].floorHeight <= q.z[i + lane]) below[lane] = s;
+                else if (above[lane] < 0) above[lane] = s;
+            }
+        }
+        result[q.order[i]] = below[0] >= 0 ? below[0] : above[0];
+        result[q.order[i + 1]] = below[1] >= 0 ? below[1] : above[1];
+    }
+#endif
+    for (; i < last; i++) result[q.order[i]] = getSectorForPosition(q.x[i], q.y[i], q.z[i]);
+}
+
+static void blockedRun(const SortedQueries& q, int cell, int first, int last, void* out) {
+    Uint8* result = (Uint8*)out;
+    const double pad2 = GRID_QUERY_PAD * GRID_QUERY_PAD;
+    if (cell < 0) {
+        // Outside the padded grid nothing is within reach of a small radius
+        for (int i = first; i < last; i++) {
+            bool blocked = q.radius2[i] > pad2 && isMovementBlocked(q.x[i], q.y[i], sqrt(q.radius2[i]));
+            result[q.order[i]] = blocked ? 1 : 0;
+        }
+        return;
+    }
+
+    const vector<int>& walls = collisionGrid.cellWalls[cell];
+    int i = first;
+#ifdef __SSE2__
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d one = _mm_set1_pd(1.0);
+    for (; i + 1 < last; i += 2) {
+        if (q.radius2[i] > pad2 || q.radius2[i + 1] > pad2) break;
+        __m128d px = _mm_loadu_pd(&q.x[i]);
+        __m128d py = _mm_loadu_pd(&q.y[i]);
+        __m128d r2 = _mm_loadu_pd(&q.radius2[i]);
+        __m128d blocked = _mm_setzero_pd();
+
+        for (int id : walls) {
+            const GridWall& w = gridWalls[id];
+            if (!w.blocks) continue;
+            __m128d x1 = _mm_set1_pd(w.x1), y1 = _mm_set1_pd(w.y1);
+            __m128d dx = _mm_set1_pd(w.dx), dy = _mm_set1_pd(w.dy);
+            __m128d relX = _mm_sub_pd(px, x1), relY = _mm_sub_pd(py, y1);
+            __m128d t = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(relX, dx), _mm_mul_pd(relY, dy)), _mm_set1_pd(w.invLength2));
+            t = _mm_min_pd(_mm_max_pd(t, zero), one);
+            __m128d ex = _mm_sub_pd(relX, _mm_mul_pd(t, dx));
+            __m128d ey = _mm_sub_pd(relY, _mm_mul_pd(t, dy));
+            __m128d dist2 = _mm_add_pd(_mm_mul_pd(ex, ex), _mm_mul_pd(ey, ey));
+            blocked = _mm_or_pd(blocked, _mm_cmplt_pd(dist2, r2));
+        }
+        int mask = _mm_movemask_pd(blocked);
+        result[q.order[i]] = (mask & 1) ? 1 : 0;
+        result[q.order[i + 1]] = (mask & 2) ? 1 : 0;
+    }
+#endif
+    for (; i < last; i++) {
+        double radius = sqrt(q.radius2[i]);
+        if (q.radius2[i] > pad2) {
+            result[q.order[i]] = isMovementBlocked(q.x[i], q.y[i], radius) ? 1 : 0;
+            continue;
+        }
+        bool blocked = false;
+        for (int id : walls) {
+            const GridWall& w = gridWalls[id];
+            if (!w.blocks) continue;
+            double relX = q.x[i] - w.x1, relY = q.y[i] - w.y1;
+            double t = (relX * w.dx + relY * w.dy) * w.invLength2;
+            t = min(max(t, 0.0), 1.0);
+            double ex = relX - t * w.dx, ey = relY - t * w.dy;
+            if (ex * ex + ey * ey < q.radius2[i]) {
+                blocked = true;
+                break;
+            }
+        }
+        result[q.order[i]] = blocked ? 1 : 0;
+    }
+}
+
+void getSectorsForPositions(const double* xs, const double* ys, const double* zs, int count, int* outSectors) {
+    if (count <= 0) return;
+    static thread_local SortedQueries q;
+    sortQueriesByCell(xs, ys, zs, nullptr, count, q);
+    forEachCellRun(q, count, sectorRun, outSectors);
+}
+
+void areMovementsBlocked(const double* xs, const double* ys, const double* radii, int count, Uint8* outBlocked) {
+    if (count <= 0) return;
+    static thread_local SortedQueries q;
+    sortQueriesByCell(xs, ys, nullptr, radii, count, q);
+    forEachCellRun(q, count, blockedRun, outBlocked);
+}
@@ -0,0 +1,38 @@
+// collision.h
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+
+// Uniform grid over the map. Each cell lists the walls and portals within
+// GRID_QUERY_PAD of it and the sectors whose bounds overlap it, lowest
+// floor first. Whether a
+// portal blocks is a flag on the wall, refreshed when its sectors move.
+const double GRID_CELL_SIZE = 2.0;
+const double GRID_QUERY_PAD = 0.5; // largest radius the batch path handles
+
+struct CollisionGrid {
+    double originX = 0.0, originY = 0.0;
+    int width = 0, height = 0;
+    std::vector<std::vector<int>> cellWalls;   // global wall ids
+    std::vector<std::vector<int>> cellSectors;
+    std::vector<int> sectorWallBase;           // global id = base[sector] + wall index
+    std::vector<int> wallSector;               // global id -> sector
+};
+
+extern CollisionGrid collisionGrid;
+
+void buildCollisionGrid();
+int gridCellForPosition(double x, double y); // -1 outside the grid
+void collisionRefreshSector(int sector);
+void collisionRefitWall(int sector, int wallIndex);
+
+// Batch forms of getSectorForPosition and isMovementBlocked. Queries are sorted by grid cell so each run of queries shares
+// one wall list, evaluated two queries at a time with SSE2, and the runs
+// are spread over the job system.
+// zs as for getSectorForPosition's z; nullptr gives the top sector like the x/y form.
+void getSectorsForPositions(const double* xs, const double* ys, const double* zs, int count, int* outSectors);
+void areMovementsBlocked(const double* xs, const double* ys, const double* radii, int count, Uint8* outBlocked);
+
+#endif
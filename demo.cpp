@@ -0,0 +1,79 @@
+#include <iostream>
+#include <SDL2/SDL.h>
+#include <fstream>
+#include <cstring>
+#include <string>
+#include "demo.h"
+
+using namespace std;
+
+static const char DEMO_MAGIC[4] = { 'D', 'E', 'M', 'O' };
+static const Uint32 DEMO_VERSION = 2;
+static const Uint32 DEMO_MAX_MAP_NAME = 4096;
+
+bool demoSave(const string& filename, const Demo& demo) {
+    ofstream file(filename, ios::binary);
+    if (!file.is_open()) {
+        cerr << "Failed to write demo " << filename << endl;
+        return false;
+    }
+
+    Uint32 count = (Uint32)demo.ticks.size();
+    Uint32 nameLength = (Uint32)demo.mapFile.size();
+    file.write(DEMO_MAGIC, sizeof(DEMO_MAGIC));
+    file.write((const char*)&DEMO_VERSION, sizeof(DEMO_VERSION));
+    file.write((const char*)&demo.tickRate, sizeof(demo.tickRate));
+    file.write((const char*)&nameLength, sizeof(nameLength));
+    file.write(demo.mapFile.data(), nameLength);
+    file.write((const char*)&demo.spawnCount, sizeof(demo.spawnCount));
+    file.write((const char*)&demo.spawnSeed, sizeof(demo.spawnSeed));
+    file.write((const char*)&demo.start, sizeof(demo.start));
+    file.write((const char*)&count, sizeof(count));
+    file.write((const char*)demo.ticks.data(), count);
+    file.write((const char*)&demo.end, sizeof(demo.end));
+    return file.good();
+}
+
+bool demoLoad(const string& filename, Demo& demo) {
+    ifstream file(filename, ios::binary);
+    if (!file.is_open()) {
+        cerr << "Failed to open demo " << filename << endl;
+        return false;
+    }
+
+    char magic[4];
+    Uint32 version = 0, count = 0;
+    file.read(magic, sizeof(magic));
+    file.read((char*)&version, sizeof(version));
+    if (!file || memcmp(magic, DEMO_MAGIC, sizeof(magic)) != 0 || version != DEMO_VERSION) {
+        cerr << filename << " is not a version " << DEMO_VERSION << " demo" << endl;
+        return false;
+    }
+
+    Uint32 nameLength = 0;
+    file.read((char*)&demo.tickRate, sizeof(demo.tickRate));
+    file.read((char*)&nameLength, sizeof(nameLength));
+    if (!file || nameLength > DEMO_MAX_MAP_NAME) {
+        cerr << "Bad map name in demo " << filename << endl;
+        return false;
+    }
+    demo.mapFile.resize(nameLength);
+    file.read(&demo.mapFile[0], nameLength);
+    file.read((char*)&demo.spawnCount, sizeof(demo.spawnCount));
+    file.read((char*)&demo.spawnSeed, sizeof(demo.spawnSeed));
+    file.read((char*)&demo.start, sizeof(demo.start));
+    file.read((char*)&count, sizeof(count));
+    demo.ticks.resize(count);
+    file.read((char*)demo.ticks.data(), count);
+    file.read((char*)&demo.end, sizeof(demo.end));
+    if (!file) {
+        cerr << "Truncated demo " << filename << endl;
+        return false;
+    }
+    return true;
+}
+
+// Compared bitwise on purpose: a replay is only useful if it is identical.
+bool demoCamerasMatch(const CameraState& a, const CameraState& b) {
+    return memcmp(&a, &b, sizeof(CameraState)) == 0;
+}
@@ -0,0 +1,31 @@
+// demo.h
+#ifndef DEMO_H
+#define DEMO_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+#include <string>
+#include "helpers.h"
+
+// Demo file layout (native endianness):
+//   "DEMO" magic, Uint32 version, Uint32 tick rate,
+//   Uint32 map name length and the name's bytes, Uint32 spawn count, Uint32 spawn seed,
+//   starting CameraState (6 doubles), Uint32 tick count,
+//   one input byte per tick, ending CameraState (6 doubles).
+// The map and spawns are replayed from the header; the ending state lets
+// playback verify the run was bit-exact.
+struct Demo {
+    Uint32 tickRate = 0;
+    std::string mapFile;
+    Uint32 spawnCount = 0;
+    Uint32 spawnSeed = 0;
+    CameraState start;
+    CameraState end;
+    std::vector<Uint8> ticks;
+};
+
+bool demoSave(const std::string& filename, const Demo& demo);
+bool demoLoad(const std::string& filename, Demo& demo);
+bool demoCamerasMatch(const CameraState& a, const CameraState& b);
+
+#endif
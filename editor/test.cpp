@@ -5,6 +5,7 @@
 #include <cmath>
 #include <string>
 #include <algorithm>
+#include "../jobs.h"
 
 struct Wall {
     float x1, y1, x2, y2;
@@ -77,9 +78,9 @@ void drawLine(SDL_Renderer* rend, SDL_FPoint a, SDL_FPoint b, bool portal = fals
     }
 }
 
-void outputMap() {
+void outputMap(const std::vector<Sector>& mapSectors) {
     printf("# sector_id wall_count floor_height ceiling_height\n");
-    for (auto &sec : sectors) {
+    for (auto &sec : mapSectors) {
         printf("%d %lu %.2f %.2f\n", sec.id, sec.walls.size(), sec.floor_height, sec.ceiling_height);
         for (auto &w : sec.walls) {
             printf("%.2f %.2f %.2f %.2f %d %d\n", w.x1, w.y1, w.x2, w.y2, w.isPortal?1:0, w.adjoiningSector);
@@ -215,8 +216,11 @@ int main(int argc, char** argv) {
         return 1;
     }
 
+    jobsInit();
+
     bool quit = false;
     bool sectorClosed = false;
+    JobHandle outputJob;
 
     while (!quit) {
         SDL_Event e;
@@ -278,7 +282,10 @@ int main(int argc, char** argv) {
 
                 case SDL_KEYDOWN:
                     if (e.key.keysym.sym == SDLK_RETURN) {
-                        outputMap();
+                        // Write a snapshot in the background; chaining on the previous
+                        // output keeps dumps in order if Enter is pressed repeatedly
+                        std::vector<Sector> snapshot = sectors;
+                        outputJob = jobsSubmit([snapshot] { outputMap(snapshot); }, { outputJob });
                     }
                     break;
             }
@@ -323,6 +330,9 @@ int main(int argc, char** argv) {
         SDL_Delay(16);
     }
 
+    jobsWait(outputJob);
+    jobsShutdown();
+
     TTF_CloseFont(font);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
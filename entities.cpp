@@ -0,0 +1,238 @@
+#include <iostream>
+#include <SDL2/SDL.h>
+#include <vector>
+#include <cmath>
+#include <mutex>
+#include <random>
+#include <algorithm>
+#include "helpers.h"
+#include "entities.h"
+#include "jobs.h"
+#include "collision.h"
+
+using namespace std;
+
+EntityStore entities;
+vector<SectorCrossing> sectorCrossings;
+SectorBuckets sectorBuckets;
+Uint32 entityVersion = 0;
+
+const double MONSTER_SPEED = 1.5;
+const double MONSTER_RADIUS = 0.2;
+const double PICKUP_RADIUS = 0.15;
+const int ENTITY_GRAIN = 256;
+
+static int appendEntity(double x, double y, double radius, Uint32 flags, int sector) {
+    entityVersion++;
+    entities.posX.push_back(x);
+    entities.posY.push_back(y);
+    entities.velX.push_back(0.0);
+    entities.velY.push_back(0.0);
+    entities.sector.push_back(sector);
+    entities.radius.push_back(radius);
+    entities.flags.push_back(flags);
+    entities.alertX.push_back(x);
+    entities.alertY.push_back(y);
+    entities.thinkTick.push_back(0);
+    return entities.count() - 1;
+}
+
+int spawnEntity(double x, double y, double radius, Uint32 flags, double feetZ) {
+    return appendEntity(x, y, radius, flags, getSectorForFeet(x, y, feetZ));
+}
+
+void spawnEntities(const double* xs, const double* ys, const double* feetZs, const double* radii, const Uint32* flags, int count) {
+    static vector<int> found;
+    static vector<double> probes;
+    found.resize(max(count, 0));
+    probes.resize(max(count, 0));
+    for (int k = 0; k < count; k++) probes[k] = feetProbeHeight(feetZs[k]);
+    getSectorsForPositions(xs, ys, probes.data(), count, found.data());
+    for (int k = 0; k < count; k++) appendEntity(xs[k], ys[k], radii[k], flags[k], found[k]);
+}
+
+// Swap-and-pop so the arrays stay dense; the last entity takes this index.
+void removeEntity(int index) {
+    int last = entities.count() - 1;
+    if (index < 0 || index > last) return;
+    entityVersion++;
+
+    entities.posX[index] = entities.posX[last];
+    entities.posY[index] = entities.posY[last];
+    entities.velX[index] = entities.velX[last];
+    entities.velY[index] = entities.velY[last];
+    entities.sector[index] = entities.sector[last];
+    entities.radius[index] = entities.radius[last];
+    entities.flags[index] = entities.flags[last];
+    entities.alertX[index] = entities.alertX[last];
+    entities.alertY[index] = entities.alertY[last];
+    entities.thinkTick[index] = entities.thinkTick[last];
+
+    entities.posX.pop_back();
+    entities.posY.pop_back();
+    entities.velX.pop_back();
+    entities.velY.pop_back();
+    entities.sector.pop_back();
+    entities.radius.pop_back();
+    entities.flags.pop_back();
+    entities.alertX.pop_back();
+    entities.alertY.pop_back();
+    entities.thinkTick.pop_back();
+}
+
+void clearEntities() {
+    entityVersion++;
+    entities = EntityStore();
+    sectorCrossings.clear();
+}
+
+// Scatters monsters and pickups over random sectors. A fixed seed keeps
+// demo and timedemo runs comparable.
+void spawnRandomEntities(int count, unsigned seed) {
+    if (sectors.empty()) return;
+
+    mt19937 rng(seed);
+    uniform_int_distribution<int> pickSector(0, (int)sectors.size() - 1);
+    uniform_real_distribution<double> unit(0.0, 1.0);
+
+    int spawned = 0;
+    for (int attempt = 0; spawned < count && attempt < count * 20; attempt++) {
+        const Sector& sector = sectors[pickSector(rng)];
+        if (sector.walls.empty()) continue;
+
+        double minX = sector.walls[0].x1, maxX = minX;
+        double minY = sector.walls[0].y1, maxY = minY;
+        for (const Wall& wall : sector.walls) {
+            minX = min(minX, min(wall.x1, wall.x2));
+            maxX = max(maxX, max(wall.x1, wall.x2));
+            minY = min(minY, min(wall.y1, wall.y2));
+            maxY = max(maxY, max(wall.y1, wall.y2));
+        }
+
+        double x = minX + (maxX - minX) * unit(rng);
+        double y = minY + (maxY - minY) * unit(rng);
+        bool monster = unit(rng) < 0.75;
+        double radius = monster ? MONSTER_RADIUS : PICKUP_RADIUS;
+        int at = getSectorForFeet(x, y, sector.floorHeight);
+        if (at < 0 || isMovementBlocked(x, y, radius)) continue;
+
+        int e = appendEntity(x, y, radius, monster ? ENTITY_MONSTER : ENTITY_PICKUP, at);
+        if (monster) {
+            double angle = unit(rng) * 2.0 * M_PI;
+            entities.velX[e] = cos(angle) * MONSTER_SPEED;
+            entities.velY[e] = sin(angle) * MONSTER_SPEED;
+        }
+        spawned++;
+    }
+    rebuildSectorBuckets();
+}
+
+void updateEntities(double dt) {
+    sectorCrossings.clear();
+
+    // Only entities with velocity need collision queries
+    static vector<int> moving;
+    static vector<double> oldX, oldY, queryX, queryY, queryRadius;
+    static vector<Uint8> blocked;
+    moving.clear();
+    for (int i = 0; i < entities.count(); i++) {
+        if (entities.velX[i] != 0.0 || entities.velY[i] != 0.0) moving.push_back(i);
+    }
+    int n = (int)moving.size();
+    if (n > 0) entityVersion++;
+    oldX.resize(n);
+    oldY.resize(n);
+    queryX.resize(n);
+    queryY.resize(n);
+    queryRadius.resize(n);
+    blocked.resize(n);
+
+    double* posX = entities.posX.data();
+    double* posY = entities.posY.data();
+    double* velX = entities.velX.data();
+    double* velY = entities.velY.data();
+
+    // Same axis-separated slide as the player, bouncing off what blocks us.
+    // Each axis is one batch query over every moving entity.
+    for (int k = 0; k < n; k++) {
+        int i = moving[k];
+        oldX[k] = posX[i];
+        oldY[k] = posY[i];
+        queryX[k] = posX[i] + velX[i] * dt;
+        queryY[k] = posY[i];
+        queryRadius[k] = entities.radius[i];
+    }
+    areMovementsBlocked(queryX.data(), queryY.data(), queryRadius.data(), n, blocked.data());
+    for (int k = 0; k < n; k++) {
+        int i = moving[k];
+        if (!blocked[k]) posX[i] = queryX[k];
+        else velX[i] = -velX[i];
+        queryX[k] = posX[i];
+        queryY[k] = oldY[k] + velY[i] * dt;
+    }
+    areMovementsBlocked(queryX.data(), queryY.data(), queryRadius.data(), n, blocked.data());
+    for (int k = 0; k < n; k++) {
+        int i = moving[k];
+        if (!blocked[k]) posY[i] = queryY[k];
+        else velY[i] = -velY[i];
+    }
+
+    mutex crossingMutex;
+    parallelFor(0, n, ENTITY_GRAIN, [&](int first, int last) {
+        vector<SectorCrossing> crossings;
+        int* sector = entities.sector.data();
+        for (int k = first; k < last; k++) {
+            int i = moving[k];
+            int from = sector[i];
+            double probe = from >= 0 ? feetProbeHeight(sectors[from].floorHeight) : INFINITY;
+            SectorCrossing c;
+            int to = updateSectorForMove(from, oldX[k], oldY[k], posX[i], posY[i], probe, c.hops, &c.hopCount);
+            // Collision keeps centers off solid walls and only checks that some
+            // opening on a line fits, so a graze or a too-high step lands here
+            if (to < 0) {
+                to = getSectorForPosition(posX[i], posY[i], probe);
+                c.hopCount = 0;
+            }
+            if (to != from) {
+                sector[i] = to;
+                c.entity = i;
+                c.fromSector = from;
+                c.toSector = to;
+                c.oldX = oldX[k];
+                c.oldY = oldY[k];
+                crossings.push_back(c);
+            }
+        }
+
+        if (!crossings.empty()) {
+            lock_guard<mutex> lock(crossingMutex);
+            sectorCrossings.insert(sectorCrossings.end(), crossings.begin(), crossings.end());
+        }
+    });
+
+    // Chunks finish in any order; keep the event list deterministic for demos
+    sort(sectorCrossings.begin(), sectorCrossings.end(),
+         [](const SectorCrossing& a, const SectorCrossing& b) { return a.entity < b.entity; });
+
+    rebuildSectorBuckets();
+}
+
+// Counting sort by sector. Entities outside every sector are left out.
+void rebuildSectorBuckets() {
+    int sectorCount = (int)sectors.size();
+    vector<int>& start = sectorBuckets.sectorStart;
+    start.assign(sectorCount + 1, 0);
+
+    const int* sector = entities.sector.data();
+    int n = entities.count();
+    for (int i = 0; i < n; i++) {
+        if (sector[i] >= 0 && sector[i] < sectorCount) start[sector[i] + 1]++;
+    }
+    for (int s = 0; s < sectorCount; s++) start[s + 1] += start[s];
+
+    sectorBuckets.sectorEntities.resize(start[sectorCount]);
+    vector<int> cursor(start.begin(), start.end() - 1);
+    for (int i = 0; i < n; i++) {
+        if (sector[i] >= 0 && sector[i] < sectorCount) sectorBuckets.sectorEntities[cursor[sector[i]]++] = i;
+    }
+}
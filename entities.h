@@ -0,0 +1,62 @@
+// entities.h
+#ifndef ENTITIES_H
+#define ENTITIES_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+#include "helpers.h"
+
+enum {
+    ENTITY_MONSTER = 1 << 0,
+    ENTITY_PICKUP = 1 << 1,
+    ENTITY_ALERTED = 1 << 2,  // heard a noise; alertX/alertY hold where it came from
+    ENTITY_SEES_PLAYER = 1 << 3, // as of its last AI think
+};
+
+// Component arrays, one element per entity. Update passes walk these
+// contiguously; entity i is index i in every array.
+struct EntityStore {
+    std::vector<double> posX, posY;
+    std::vector<double> velX, velY;
+    std::vector<int> sector;       // kept current by portal-crossing checks
+    std::vector<double> radius;
+    std::vector<Uint32> flags;
+    std::vector<double> alertX, alertY;
+    std::vector<Uint32> thinkTick; // AI tick of the last think
+
+    int count() const { return (int)posX.size(); }
+};
+
+// Entities grouped by cached sector, rebuilt at the end of every update:
+// the entities in sector s are sectorEntities[sectorStart[s] .. sectorStart[s + 1]).
+struct SectorBuckets {
+    std::vector<int> sectorStart;
+    std::vector<int> sectorEntities;
+};
+
+// Produced by updateEntities whenever an entity moves through a portal.
+struct SectorCrossing {
+    int entity;
+    int fromSector, toSector;
+    double oldX, oldY; // where this tick's move started
+    int hopCount;      // portals crossed on the way, none if the sector had to be looked up
+    SectorHop hops[MAX_SECTOR_HOPS];
+};
+
+extern EntityStore entities;
+extern std::vector<SectorCrossing> sectorCrossings;
+extern SectorBuckets sectorBuckets;
+extern Uint32 entityVersion; // bumped whenever any entity is added, removed or moved
+
+// Entities stand on a floor: the one they can step onto from feetZ, by
+// default the lowest at (x, y) where sectors are stacked.
+int spawnEntity(double x, double y, double radius, Uint32 flags, double feetZ = -INFINITY);
+// Many at once, with one batched sector lookup; used for map things.
+void spawnEntities(const double* xs, const double* ys, const double* feetZs, const double* radii, const Uint32* flags, int count);
+void removeEntity(int index);
+void clearEntities();
+void spawnRandomEntities(int count, unsigned seed);
+void updateEntities(double dt);
+void rebuildSectorBuckets();
+
+#endif
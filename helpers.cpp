@@ -6,28 +6,87 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <algorithm>
+#include <cstring>
+
+
+#include "helpers.h"
+#include "jobs.h"
+#include "entities.h"
+#include "collision.h"
+#include "los.h"
+#include "path.h"
+#include "noise.h"
+#include "movers.h"
+#include "polyobj.h"
+#include "ai.h"
+#include "particles.h"
+#include "triggers.h"
+#include "render.h"
+#include "portals.h"
 
 
 using namespace std;
 
-struct Wall {
-    double x1, y1, x2, y2;
-    bool isPortal;
-    int adjoiningSector; // -1 if solid wall
-};
-
-struct Sector {
-    vector<Wall> walls;
-    double floorHeight = 0.0;
-    double ceilingHeight = 3.0;
-};
-
 vector<Sector> sectors;
 
+Uint32 worldVersion = 0;
+Uint32 geometryVersion = 0;
+vector<Uint32> sectorVersion;
+
 double posX = 2.0, posY = 2.0;
+double posZ = NAN; // unknown until the first tick settles it
 double dirX = -1.0, dirY = 0.0;
 double planeX = 0.0, planeY = 0.66;
 
+Uint8 sampleInput(const Uint8* keystate) {
+    Uint8 buttons = 0;
+    if (keystate[SDL_SCANCODE_W]) buttons |= INPUT_FORWARD;
+    if (keystate[SDL_SCANCODE_S]) buttons |= INPUT_BACK;
+    if (keystate[SDL_SCANCODE_A]) buttons |= INPUT_TURN_LEFT;
+    if (keystate[SDL_SCANCODE_D]) buttons |= INPUT_TURN_RIGHT;
+    if (keystate[SDL_SCANCODE_E]) buttons |= INPUT_USE;
+    if (keystate[SDL_SCANCODE_SPACE]) buttons |= INPUT_FIRE;
+    return buttons;
+}
+
+CameraState captureCamera() {
+    return { posX, posY, dirX, dirY, planeX, planeY };
+}
+
+void applyCamera(const CameraState& cam) {
+    posX = cam.posX;
+    posY = cam.posY;
+    dirX = cam.dirX;
+    dirY = cam.dirY;
+    planeX = cam.planeX;
+    planeY = cam.planeY;
+}
+
+// Blend two tick states for rendering. Direction and plane are renormalized
+// so the interpolated view never shrinks while turning.
+CameraState interpolateCamera(const CameraState& a, const CameraState& b, double alpha) {
+    CameraState c;
+    c.posX = a.posX + (b.posX - a.posX) * alpha;
+    c.posY = a.posY + (b.posY - a.posY) * alpha;
+
+    double dx = a.dirX + (b.dirX - a.dirX) * alpha;
+    double dy = a.dirY + (b.dirY - a.dirY) * alpha;
+    double dirLen = sqrt(dx * dx + dy * dy);
+    if (dirLen < 1e-9) return b;
+    c.dirX = dx / dirLen;
+    c.dirY = dy / dirLen;
+
+    double px = a.planeX + (b.planeX - a.planeX) * alpha;
+    double py = a.planeY + (b.planeY - a.planeY) * alpha;
+    double planeLen = sqrt(px * px + py * py);
+    double targetLen = sqrt(b.planeX * b.planeX + b.planeY * b.planeY);
+    if (planeLen < 1e-9) return b;
+    c.planeX = px / planeLen * targetLen;
+    c.planeY = py / planeLen * targetLen;
+    return c;
+}
+
 void drawVerticalLine(SDL_Surface* surface, int x, int start, int end, Uint32 color) {
     for (int y = start; y < end; y++) {
         Uint32* pixels = (Uint32*)surface->pixels;
@@ -56,30 +115,60 @@ bool intersectRayWithSegment(double rayX, double rayY, double rayDX, double rayD
     return false;
 }
 
-int getSectorForPosition(double x, double y) {
-    int bestSector = -1;
-    double highestFloor = -1e9; // very low initial value
-
-    for (int i = 0; i < (int)sectors.size(); ++i) {
-        const Sector& sector = sectors[i];
-        int crossings = 0;
-        for (const Wall& wall : sector.walls) {
-            double x1 = wall.x1, y1 = wall.y1;
-            double x2 = wall.x2, y2 = wall.y2;
-
-            if (((y1 > y) != (y2 > y)) &&
-                (x < (x2 - x1) * (y - y1) / (y2 - y1 + 1e-10) + x1)) {
-                crossings++;
-            }
+static bool sectorContains(const Sector& sector, double x, double y) {
+    int crossings = 0;
+    for (const Wall& wall : sector.walls) {
+        if (!wallOnOutline(wall)) continue;
+        double x1 = wall.x1, y1 = wall.y1;
+        double x2 = wall.x2, y2 = wall.y2;
+
+        if (((y1 > y) != (y2 > y)) &&
+            (x < (x2 - x1) * (y - y1) / (y2 - y1 + 1e-10) + x1)) {
+            crossings++;
         }
-        if (crossings % 2 == 1) {
-            if (sector.floorHeight > highestFloor) {
-                highestFloor = sector.floorHeight;
-                bestSector = i;
+    }
+    return crossings % 2 == 1;
+}
+
+int getSectorForPosition(double x, double y) {
+    return getSectorForPosition(x, y, INFINITY);
+}
+
+// Grid cells list their sectors by floor height, so the level is a binary
+// search and only the sectors around it get the point-in-polygon test.
+int getSectorForPosition(double x, double y, double z) {
+    const CollisionGrid& grid = collisionGrid;
+    if (grid.width == 0) {
+        // No grid yet: scan everything, same rule
+        int below = -1, above = -1;
+        for (int i = 0; i < (int)sectors.size(); ++i) {
+            double floorHeight = sectors[i].floorHeight;
+            if (!sectorContains(sectors[i], x, y)) continue;
+            if (floorHeight <= z) {
+                if (below < 0 || floorHeight > sectors[below].floorHeight) below = i;
+            } else if (above < 0 || floorHeight < sectors[above].floorHeight) {
+                above = i;
             }
         }
+        return below >= 0 ? below : above;
+    }
+
+    int cell = gridCellForPosition(x, y);
+    if (cell < 0) return -1;
+    const vector<int>& candidates = grid.cellSectors[cell];
+    int split = (int)(upper_bound(candidates.begin(), candidates.end(), z,
+                                  [](double height, int s) { return height < sectors[s].floorHeight; }) - candidates.begin());
+    for (int k = split - 1; k >= 0; k--) {
+        if (sectorContains(sectors[candidates[k]], x, y)) return candidates[k];
     }
-    return bestSector;
+    for (int k = split; k < (int)candidates.size(); k++) {
+        if (sectorContains(sectors[candidates[k]], x, y)) return candidates[k];
+    }
+    return -1;
+}
+
+int getSectorForFeet(double x, double y, double feetZ) {
+    return getSectorForPosition(x, y, feetProbeHeight(feetZ));
 }
 
 
@@ -107,23 +196,152 @@ double pointToSegmentDistance(double px, double py, double x1, double y1, double
     return sqrt(dx*dx + dy*dy);
 }
 
-const double COLLISION_RADIUS = 0.1;
+void setSectorPlanes(int sector, double floorHeight, double ceilingHeight) {
+    if (sector < 0 || sector >= (int)sectors.size()) return;
+    sectors[sector].floorHeight = floorHeight;
+    sectors[sector].ceilingHeight = ceilingHeight;
 
-bool isMovementBlocked(double newX, double newY) {
-    for (const Sector& sector : sectors) {
-        for (const Wall& wall : sector.walls) {
-            if (!wall.isPortal) {
-                double dist = pointToSegmentDistance(newX, newY, wall.x1, wall.y1, wall.x2, wall.y2);
-                if (dist < COLLISION_RADIUS) {
-                    return true;
-                }
-            }
+    sectorVersion[sector] = ++worldVersion;
+    collisionRefreshSector(sector);
+    pathInvalidateSector(sector);
+    noiseInvalidateSector(sector);
+}
+
+// Portals block like solid walls once the opening through them is too
+// low to fit through, e.g. a closed door.
+static bool openingTooLow(int sector, const Wall& wall) {
+    int n = wall.adjoiningSector;
+    if (n < 0 || n >= (int)sectors.size()) return false;
+    const Sector& a = sectors[sector];
+    const Sector& b = sectors[n];
+    return min(a.ceilingHeight, b.ceilingHeight) - max(a.floorHeight, b.floorHeight) < AGENT_HEIGHT;
+}
+
+bool wallBlocksMovement(int sector, const Wall& wall) {
+    if (!wall.isPortal) return true;
+    if (!openingTooLow(sector, wall)) return false;
+    // A line with stacked openings lets you through if any of them does
+    for (const Wall& other : sectors[sector].walls) {
+        if (&other == &wall || !other.isPortal || other.x1 != wall.x1 || other.y1 != wall.y1 ||
+            other.x2 != wall.x2 || other.y2 != wall.y2) continue;
+        if (!openingTooLow(sector, other)) return false;
+    }
+    return true;
+}
+
+int openingAtHeight(int sector, int wall, double z) {
+    const vector<Wall>& walls = sectors[sector].walls;
+    const Wall& w = walls[wall];
+    for (int i = 0; i < (int)walls.size(); i++) {
+        const Wall& other = walls[i];
+        if (i != wall && (other.x1 != w.x1 || other.y1 != w.y1 || other.x2 != w.x2 || other.y2 != w.y2)) continue;
+        int n = other.adjoiningSector;
+        if (!other.isPortal || n < 0 || n >= (int)sectors.size()) continue;
+        double openBottom = max(sectors[sector].floorHeight, sectors[n].floorHeight);
+        double openTop = min(sectors[sector].ceilingHeight, sectors[n].ceilingHeight);
+        if (z >= openBottom && z < openTop) return i;
+    }
+    return -1;
+}
+
+int findBackWall(int sector, int wall) {
+    const double epsilon = 1e-6;
+    const Wall& w = sectors[sector].walls[wall];
+    int n = w.adjoiningSector;
+    if (!w.isPortal || n < 0 || n >= (int)sectors.size()) return -1;
+    for (int i = 0; i < (int)sectors[n].walls.size(); i++) {
+        const Wall& b = sectors[n].walls[i];
+        if (!b.isPortal || b.adjoiningSector != sector) continue;
+        bool reversed = fabs(b.x1 - w.x2) < epsilon && fabs(b.y1 - w.y2) < epsilon &&
+                        fabs(b.x2 - w.x1) < epsilon && fabs(b.y2 - w.y1) < epsilon;
+        bool same = fabs(b.x1 - w.x1) < epsilon && fabs(b.y1 - w.y1) < epsilon &&
+                    fabs(b.x2 - w.x2) < epsilon && fabs(b.y2 - w.y2) < epsilon;
+        if (reversed || same) return i;
+    }
+    return -1;
+}
+
+static bool wallStopsMove(int s, const Wall& wall, double newX, double newY, double radius, double feetZ, bool throughLinks) {
+    if (!isnan(feetZ) && (feetZ + AGENT_HEIGHT <= sectors[s].floorHeight || feetZ >= sectors[s].ceilingHeight)) return false;
+    if (throughLinks && wall.link >= 0 && !portalLinks[wall.link].mirror) return false;
+    return wallBlocksMovement(s, wall) && pointToSegmentDistance(newX, newY, wall.x1, wall.y1, wall.x2, wall.y2) < radius;
+}
+
+// Small radii only look at the walls listed in the point's grid cell, the
+// same lists the batch queries use; the rest scan every wall.
+bool isMovementBlocked(double newX, double newY, double radius, double feetZ, bool throughLinks) {
+    const CollisionGrid& grid = collisionGrid;
+    if (radius <= GRID_QUERY_PAD && grid.width > 0 && grid.sectorWallBase.size() == sectors.size() + 1) {
+        int cell = gridCellForPosition(newX, newY);
+        if (cell < 0) return false; // outside the padded grid nothing is within reach
+        for (int id : grid.cellWalls[cell]) {
+            int s = grid.wallSector[id];
+            if (wallStopsMove(s, sectors[s].walls[id - grid.sectorWallBase[s]], newX, newY, radius, feetZ, throughLinks)) return true;
+        }
+        return false;
+    }
+
+    for (int s = 0; s < (int)sectors.size(); s++) {
+        for (const Wall& wall : sectors[s].walls) {
+            if (wallStopsMove(s, wall, newX, newY, radius, feetZ, throughLinks)) return true;
         }
     }
     return false;
 }
 
+bool segmentsIntersect(double ax, double ay, double bx, double by,
+                       double cx, double cy, double dx, double dy) {
+    double rx = bx - ax, ry = by - ay;
+    double sx = dx - cx, sy = dy - cy;
+    double denom = rx * sy - ry * sx;
+    if (fabs(denom) < 1e-12) return false;
+
+    double t = ((cx - ax) * sy - (cy - ay) * sx) / denom;
+    double u = ((cx - ax) * ry - (cy - ay) * rx) / denom;
+    return t >= 0 && t <= 1 && u >= 0 && u <= 1;
+}
 
+// Follows a short move through the portals of the sector we were in, so
+// moving objects never need a full getSectorForPosition scan. Falls back
+// to the scan only when the starting sector is unknown. Returns -1 if the
+// move goes out through a solid wall or off the map.
+int updateSectorForMove(int sector, double oldX, double oldY, double newX, double newY, double z,
+                        SectorHop* hops, int* hopCount) {
+    if (hopCount) *hopCount = 0;
+    if (sector < 0 || sector >= (int)sectors.size()) return getSectorForPosition(newX, newY, z);
+
+    double dx = newX - oldX, dy = newY - oldY;
+    double tEnter = 0.0;
+    for (int hop = 0; hop < MAX_SECTOR_HOPS; hop++) {
+        // Nearest outline wall the move crosses after entering this sector
+        const vector<Wall>& walls = sectors[sector].walls;
+        int exitWall = -1;
+        double exitT = 2.0;
+        for (int i = 0; i < (int)walls.size(); i++) {
+            const Wall& wall = walls[i];
+            if (!wallOnOutline(wall)) continue;
+            double sx = wall.x2 - wall.x1, sy = wall.y2 - wall.y1;
+            double denom = dx * sy - dy * sx;
+            if (fabs(denom) < 1e-12) continue;
+            double t = ((wall.x1 - oldX) * sy - (wall.y1 - oldY) * sx) / denom;
+            double u = ((wall.x1 - oldX) * dy - (wall.y1 - oldY) * dx) / denom;
+            if (u < 0.0 || u > 1.0 || t <= tEnter + 1e-9 || t > 1.0 || t >= exitT) continue;
+            exitT = t;
+            exitWall = i;
+        }
+        if (exitWall < 0) break;
+
+        // On a stacked line, the opening at the mover's height
+        int through = openingAtHeight(sector, exitWall, z);
+        if (through < 0) return -1;
+        int next = walls[through].adjoiningSector;
+        if (hops) hops[hop] = { sector, through, next };
+        if (hopCount) *hopCount = hop + 1;
+        sector = next;
+        tEnter = exitT;
+    }
+    return sector;
+}
 
 void loadMapFromFile(const string& filename) {
     ifstream file(filename);
@@ -132,34 +350,229 @@ void loadMapFromFile(const string& filename) {
         return;
     }
 
-    sectors.clear();
+    vector<string> lines;
     string line;
-    while (getline(file, line)) {
-        if (line.empty() || line[0] == '#') continue;
+    while (getline(file, line)) lines.push_back(line);
+    file.close();
+
+    // Find sector headers serially, then parse the wall blocks in parallel
+    struct SectorBlock {
+        size_t firstWallLine;
+        int wallCount;
+        double floorHeight, ceilingHeight;
+        bool sky;
+    };
+    struct Thing {
+        double x, y, radius;
+        int kind;
+        double feetZ;
+    };
+    struct MoverLine {
+        int sector, kind;
+        double low, high, speed;
+    };
+    struct TriggerLine {
+        int kind, sector, wall, action, target;
+        Uint32 flags;
+    };
+    struct LinkLine {
+        int sector, wall, targetSector, targetWall; // targetSector -1 for a mirror
+    };
+    struct MidLine {
+        int sector, wall, kind;
+        int r, g, b, alpha;
+    };
+    struct PolyBlock {
+        size_t firstWallLine;
+        int sector, wallCount, kind;
+        double a, b, c;
+    };
+    vector<SectorBlock> blocks;
+    vector<Thing> things;
+    vector<MoverLine> moverLines;
+    vector<PolyBlock> polyBlocks;
+    vector<TriggerLine> triggerLines;
+    vector<LinkLine> linkLines;
+    vector<MidLine> midLines;
+    clearFog();
+    for (size_t i = 0; i < lines.size(); ++i) {
+        if (lines[i].empty() || lines[i][0] == '#') continue;
+
+        stringstream ss(lines[i]);
+        if (lines[i].compare(0, 6, "thing ") == 0) {
+            string keyword;
+            Thing thing;
+            if (ss >> keyword >> thing.x >> thing.y >> thing.radius >> thing.kind) {
+                if (!(ss >> thing.feetZ)) thing.feetZ = -INFINITY;
+                things.push_back(thing);
+            }
+            continue;
+        }
+        if (lines[i].compare(0, 6, "mover ") == 0) {
+            string keyword;
+            MoverLine mover;
+            if (ss >> keyword >> mover.sector >> mover.kind >> mover.low >> mover.high >> mover.speed) moverLines.push_back(mover);
+            continue;
+        }
+        if (lines[i].compare(0, 8, "trigger ") == 0) {
+            string keyword, kind, action;
+            TriggerLine trigger;
+            if (!(ss >> keyword >> kind >> trigger.sector >> trigger.wall >> action >> trigger.target >> trigger.flags)) continue;
+            trigger.kind = kind == "enter" ? TRIGGER_ENTER : kind == "cross" ? TRIGGER_CROSS : kind == "use" ? TRIGGER_USE : -1;
+            trigger.action = action == "mover" ? TRIGGER_MOVER : action == "poly" ? TRIGGER_POLY : action == "noise" ? TRIGGER_NOISE : -1;
+            triggerLines.push_back(trigger);
+            continue;
+        }
+        if (lines[i].compare(0, 5, "link ") == 0) {
+            string keyword;
+            LinkLine link;
+            if (ss >> keyword >> link.sector >> link.wall >> link.targetSector >> link.targetWall) linkLines.push_back(link);
+            continue;
+        }
+        if (lines[i].compare(0, 7, "mirror ") == 0) {
+            string keyword;
+            LinkLine link = { -1, -1, -1, -1 };
+            if (ss >> keyword >> link.sector >> link.wall) linkLines.push_back(link);
+            continue;
+        }
+        if (lines[i].compare(0, 7, "midtex ") == 0) {
+            string keyword, kind;
+            MidLine mid;
+            if (!(ss >> keyword >> mid.sector >> mid.wall >> kind >> mid.r >> mid.g >> mid.b >> mid.alpha)) continue;
+            mid.kind = kind == "grate" ? MID_GRATE : kind == "glass" ? MID_GLASS : -1;
+            midLines.push_back(mid);
+            continue;
+        }
+        if (lines[i].compare(0, 4, "fog ") == 0) {
+            string keyword;
+            double farDistance;
+            int r, g, b;
+            if (ss >> keyword >> farDistance >> r >> g >> b) setFog(farDistance, (Uint8)r, (Uint8)g, (Uint8)b);
+            continue;
+        }
+        if (lines[i].compare(0, 5, "poly ") == 0) {
+            string keyword, kind;
+            PolyBlock poly;
+            if (!(ss >> keyword >> poly.sector >> poly.wallCount >> kind >> poly.a >> poly.b >> poly.c)) continue;
+            poly.kind = kind == "rotate" ? POLY_ROTATE : POLY_SLIDE;
+            poly.firstWallLine = i + 1;
+            polyBlocks.push_back(poly);
+            i += poly.wallCount;
+            continue;
+        }
 
-        stringstream ss(line);
         int sectorId, wallCount;
         double floorHeight, ceilingHeight;
         if (!(ss >> sectorId >> wallCount >> floorHeight >> ceilingHeight)) continue;
+        int sectorFlags = 0;
+        ss >> sectorFlags;
+
+        blocks.push_back({ i + 1, wallCount, floorHeight, ceilingHeight, (sectorFlags & 1) != 0 });
+        i += wallCount;
+    }
 
-        Sector sector;
-        sector.floorHeight = floorHeight;
-        sector.ceilingHeight = ceilingHeight;
-
-        for (int i = 0; i < wallCount; ++i) {
-            getline(file, line);
-            stringstream wallSS(line);
-            double x1, y1, x2, y2;
-            int isPortalInt, adjoining;
-            wallSS >> x1 >> y1 >> x2 >> y2 >> isPortalInt >> adjoining;
-            Wall wall = { x1, y1, x2, y2, isPortalInt != 0, adjoining };
-            sector.walls.push_back(wall);
+    sectors.clear();
+    sectors.resize(blocks.size());
+    parallelFor(0, (int)blocks.size(), 16, [&](int first, int last) {
+        for (int b = first; b < last; ++b) {
+            const SectorBlock& block = blocks[b];
+            Sector& sector = sectors[b];
+            sector.floorHeight = block.floorHeight;
+            sector.ceilingHeight = block.ceilingHeight;
+            sector.sky = block.sky;
+
+            for (int i = 0; i < block.wallCount; ++i) {
+                size_t lineIndex = block.firstWallLine + i;
+                stringstream wallSS(lineIndex < lines.size() ? lines[lineIndex] : string());
+                double x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+                int isPortalInt = 0, adjoining = -1;
+                wallSS >> x1 >> y1 >> x2 >> y2 >> isPortalInt >> adjoining;
+                Wall wall = { x1, y1, x2, y2, isPortalInt != 0, adjoining };
+                // A line listed again is another opening in the same wall, onto a stacked sector
+                for (const Wall& earlier : sector.walls) {
+                    if (earlier.x1 == x1 && earlier.y1 == y1 && earlier.x2 == x2 && earlier.y2 == y2) wall.stacked = true;
+                }
+                sector.walls.push_back(wall);
+            }
+        }
+    });
+
+    // Wall groups go after the sector outlines they sit in
+    clearPolyobjs();
+    for (const PolyBlock& poly : polyBlocks) {
+        if (poly.sector < 0 || poly.sector >= (int)sectors.size()) {
+            cerr << "Ignoring poly for sector " << poly.sector << endl;
+            continue;
         }
+        vector<Wall>& walls = sectors[poly.sector].walls;
+        int firstWall = (int)walls.size();
+        for (int i = 0; i < poly.wallCount; ++i) {
+            size_t lineIndex = poly.firstWallLine + i;
+            stringstream wallSS(lineIndex < lines.size() ? lines[lineIndex] : string());
+            double x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+            wallSS >> x1 >> y1 >> x2 >> y2;
+            Wall wall = { x1, y1, x2, y2, false, -1, true };
+            walls.push_back(wall);
+        }
+        if (addPolyobj(poly.sector, poly.kind, firstWall, poly.wallCount, poly.a, poly.b, poly.c) < 0) {
+            cerr << "Ignoring poly for sector " << poly.sector << endl;
+            walls.resize(firstWall);
+        }
+    }
 
-        sectors.push_back(sector);
+    clearPortalLinks();
+    for (const LinkLine& link : linkLines) {
+        int id = link.targetSector < 0 ? addMirror(link.sector, link.wall)
+                                       : addTeleportLink(link.sector, link.wall, link.targetSector, link.targetWall);
+        if (id < 0) cerr << "Ignoring link for sector " << link.sector << " wall " << link.wall << endl;
     }
 
-    file.close();
+    clearMidTextures();
+    for (const MidLine& mid : midLines) {
+        if (addMidTexture(mid.sector, mid.wall, mid.kind, (Uint8)mid.r, (Uint8)mid.g, (Uint8)mid.b, (Uint8)mid.alpha) < 0) {
+            cerr << "Ignoring midtex for sector " << mid.sector << " wall " << mid.wall << endl;
+        }
+    }
+
+    clearMovers();
+    clearParticles();
+    for (const MoverLine& mover : moverLines) {
+        if (addMover(mover.sector, mover.kind, mover.low, mover.high, mover.speed) < 0) {
+            cerr << "Ignoring mover for sector " << mover.sector << endl;
+        }
+    }
+
+    clearTriggers();
+    for (const TriggerLine& trigger : triggerLines) {
+        if (addTrigger(trigger.kind, trigger.sector, trigger.wall, trigger.action, trigger.target, trigger.flags) < 0) {
+            cerr << "Ignoring trigger for sector " << trigger.sector << " wall " << trigger.wall << endl;
+        }
+    }
+    buildTriggerIndex();
+
+    worldVersion++;
+    geometryVersion = worldVersion;
+    sectorVersion.assign(sectors.size(), worldVersion);
+
+    buildCollisionGrid();
+    posZ = NAN;
+    buildSectorReachability();
+    buildPortalGraph();
+    noiseClearCache();
+    aiReset();
+
+    clearEntities();
+    vector<double> thingX, thingY, thingZ, thingRadius;
+    vector<Uint32> thingFlags;
+    for (const Thing& thing : things) {
+        thingX.push_back(thing.x);
+        thingY.push_back(thing.y);
+        thingZ.push_back(thing.feetZ);
+        thingRadius.push_back(thing.radius);
+        thingFlags.push_back(thing.kind == 1 ? ENTITY_MONSTER : ENTITY_PICKUP);
+    }
+    spawnEntities(thingX.data(), thingY.data(), thingZ.data(), thingRadius.data(), thingFlags.data(), (int)things.size());
+    rebuildSectorBuckets();
 }
 
 ///DEBUGGING STUFF HERE
@@ -169,46 +582,105 @@ const int MINIMAP_SIZE = 150;
 const int MINIMAP_MARGIN = 10;
 const double MINIMAP_SCALE = 5.0; // World units to minimap pixels
 
-void renderMinimap(SDL_Surface* surface) {
-    // Draw minimap background (dark grey)
-    SDL_Rect bgRect = { MINIMAP_MARGIN, MINIMAP_MARGIN, MINIMAP_SIZE, MINIMAP_SIZE };
-    SDL_FillRect(surface, &bgRect, SDL_MapRGB(surface->format, 30, 30, 30));
-
-    // Draw walls and portals
-    for (const Sector& sector : sectors) {
-        for (const Wall& wall : sector.walls) {
-            Uint32 color = wall.isPortal ?
-                SDL_MapRGB(surface->format, 0, 255, 255) :  // Cyan for portals
-                SDL_MapRGB(surface->format, 255, 255, 255); // White for walls
-
-            int x1 = (int)(wall.x1 * MINIMAP_SCALE) + MINIMAP_MARGIN;
-            int x2 = (int)(wall.x2 * MINIMAP_SCALE) + MINIMAP_MARGIN;
-			int y1 = (int)(wall.y1 * MINIMAP_SCALE) + MINIMAP_MARGIN;
-			int y2 = (int)(wall.y2 * MINIMAP_SCALE) + MINIMAP_MARGIN;
-
-            int dx = abs(x2 - x1), sx = x1 < x2 ? 1 : -1;
-            int dy = -abs(y2 - y1), sy = y1 < y2 ? 1 : -1;
-            int err = dx + dy, e2;
-
-            int cx = x1, cy = y1;
-            while (true) {
-                if (cx >= MINIMAP_MARGIN && cx < MINIMAP_MARGIN + MINIMAP_SIZE &&
-                    cy >= MINIMAP_MARGIN && cy < MINIMAP_MARGIN + MINIMAP_SIZE) {
-                    Uint32* pixels = (Uint32*)surface->pixels;
-                    pixels[cy * (surface->pitch / 4) + cx] = color;
-                }
-                if (cx == x2 && cy == y2) break;
-                e2 = 2 * err;
-                if (e2 >= dy) {
-                    err += dy;
-                    cx += sx;
-                }
-                if (e2 <= dx) {
-                    err += dx;
-                    cy += sy;
-                }
+// Walls and portals are drawn into a cached layer and copied in each frame.
+// A change to a sector's planes only recolors the portals touching it.
+// Polyobj walls move every tick, so they stay out of the layer and are
+// drawn over the copy instead.
+static vector<Uint32> minimapLayer;
+static Uint32 minimapLayerVersion = 0;
+static Uint32 minimapLayerGeometry = 0;
+static Uint32 minimapLayerFormat = 0;
+
+// Into a MINIMAP_SIZE square of pixels, `stride` pixels per row
+static void drawMinimapWall(SDL_Surface* surface, Uint32* pixels, int stride, int sector, const Wall& wall) {
+    Uint32 color;
+    if (!wall.isPortal) color = SDL_MapRGB(surface->format, 255, 255, 255);    // White for walls
+    else if (wallBlocksMovement(sector, wall)) color = SDL_MapRGB(surface->format, 255, 165, 0); // Orange for shut portals
+    else color = SDL_MapRGB(surface->format, 0, 255, 255);                     // Cyan for portals
+
+    int x1 = (int)(wall.x1 * MINIMAP_SCALE);
+    int x2 = (int)(wall.x2 * MINIMAP_SCALE);
+    int y1 = (int)(wall.y1 * MINIMAP_SCALE);
+    int y2 = (int)(wall.y2 * MINIMAP_SCALE);
+
+    int dx = abs(x2 - x1), sx = x1 < x2 ? 1 : -1;
+    int dy = -abs(y2 - y1), sy = y1 < y2 ? 1 : -1;
+    int err = dx + dy, e2;
+
+    int cx = x1, cy = y1;
+    while (true) {
+        if (cx >= 0 && cx < MINIMAP_SIZE && cy >= 0 && cy < MINIMAP_SIZE) {
+            pixels[cy * stride + cx] = color;
+        }
+        if (cx == x2 && cy == y2) break;
+        e2 = 2 * err;
+        if (e2 >= dy) {
+            err += dy;
+            cx += sx;
+        }
+        if (e2 <= dx) {
+            err += dx;
+            cy += sy;
+        }
+    }
+}
+
+static void updateMinimapLayer(SDL_Surface* surface) {
+    if (minimapLayerGeometry != geometryVersion || minimapLayerFormat != surface->format->format) {
+        // Dark grey background, then every fixed wall
+        minimapLayer.assign(MINIMAP_SIZE * MINIMAP_SIZE, SDL_MapRGB(surface->format, 30, 30, 30));
+        for (int s = 0; s < (int)sectors.size(); s++) {
+            for (const Wall& wall : sectors[s].walls) {
+                if (!wall.polyobj) drawMinimapWall(surface, minimapLayer.data(), MINIMAP_SIZE, s, wall);
             }
         }
+        minimapLayerGeometry = geometryVersion;
+        minimapLayerFormat = surface->format->format;
+        minimapLayerVersion = worldVersion;
+        return;
+    }
+    if (minimapLayerVersion == worldVersion) return;
+
+    // Both sides of a portal are drawn, so recolor both
+    for (int s = 0; s < (int)sectors.size(); s++) {
+        if (sectorVersion[s] <= minimapLayerVersion) continue;
+        for (const Wall& wall : sectors[s].walls) {
+            int n = wall.adjoiningSector;
+            if (!wall.isPortal || n < 0 || n >= (int)sectors.size()) continue;
+            drawMinimapWall(surface, minimapLayer.data(), MINIMAP_SIZE, s, wall);
+            for (const Wall& back : sectors[n].walls) {
+                if (back.isPortal && back.adjoiningSector == s) drawMinimapWall(surface, minimapLayer.data(), MINIMAP_SIZE, n, back);
+            }
+        }
+    }
+    minimapLayerVersion = worldVersion;
+}
+
+void renderMinimap(SDL_Surface* surface) {
+    updateMinimapLayer(surface);
+    for (int row = 0; row < MINIMAP_SIZE; row++) {
+        Uint32* pixels = (Uint32*)surface->pixels + (MINIMAP_MARGIN + row) * (surface->pitch / 4) + MINIMAP_MARGIN;
+        memcpy(pixels, &minimapLayer[row * MINIMAP_SIZE], MINIMAP_SIZE * sizeof(Uint32));
+    }
+
+    Uint32* minimapPixels = (Uint32*)surface->pixels + MINIMAP_MARGIN * (surface->pitch / 4) + MINIMAP_MARGIN;
+    for (const Polyobj& p : polyobjs) {
+        for (int i = 0; i < p.wallCount; i++) {
+            drawMinimapWall(surface, minimapPixels, surface->pitch / 4, p.sector, sectors[p.sector].walls[p.firstWall + i]);
+        }
+    }
+
+    // Draw entities as single pixels: yellow monsters, green pickups
+    Uint32 monsterColor = SDL_MapRGB(surface->format, 255, 255, 0);
+    Uint32 pickupColor = SDL_MapRGB(surface->format, 0, 255, 0);
+    for (int i = 0; i < entities.count(); i++) {
+        int ex = (int)(entities.posX[i] * MINIMAP_SCALE) + MINIMAP_MARGIN;
+        int ey = (int)(entities.posY[i] * MINIMAP_SCALE) + MINIMAP_MARGIN;
+        if (ex >= MINIMAP_MARGIN && ex < MINIMAP_MARGIN + MINIMAP_SIZE &&
+            ey >= MINIMAP_MARGIN && ey < MINIMAP_MARGIN + MINIMAP_SIZE) {
+            Uint32* pixels = (Uint32*)surface->pixels;
+            pixels[ey * (surface->pitch / 4) + ex] = (entities.flags[i] & ENTITY_MONSTER) ? monsterColor : pickupColor;
+        }
     }
 
     // Draw player as red circle
@@ -5,28 +5,113 @@
 #include <SDL2/SDL.h>
 #include <vector>
 #include <string>
+#include <cmath>
 
 struct Wall {
     double x1, y1, x2, y2;
     bool isPortal;
     int adjoiningSector; // -1 if solid wall
+    bool polyobj = false; // belongs to a movable wall group, not the sector outline
+    bool stacked = false; // repeats an earlier wall's line to open onto another sector at a different height
+    int link = -1;        // index into portalLinks: shows, and may lead to, somewhere else
+    int mid = -1;         // index into midTextures: grate or glass hung in a portal
 };
 
+// Walls that bound the sector's footprint, for point-in-sector tests
+inline bool wallOnOutline(const Wall& wall) { return !wall.polyobj && !wall.stacked; }
+
 struct Sector {
     std::vector<Wall> walls;
     double floorHeight = 0.0;
     double ceilingHeight = 3.0;
+    bool sky = false; // ceiling is open sky, drawn from the panorama
 };
 
 extern std::vector<Sector> sectors;
 
+const double MAX_STEP_HEIGHT = 0.6;
+const double AGENT_HEIGHT = 1.2;
+
+// Change stamps for the derived caches. Every change bumps worldVersion
+// and stamps the sectors it touched with the new value, so a cache can
+// remember the worldVersion it last synced at and redo only the sectors
+// stamped after it. geometryVersion moves only when walls are replaced.
+extern Uint32 worldVersion;
+extern Uint32 geometryVersion;
+extern std::vector<Uint32> sectorVersion;
+
+// Moves a sector's planes and invalidates just the cache entries that
+// depend on that sector: collision flags of its portals, cached path
+// corridors and noise floods through it.
+void setSectorPlanes(int sector, double floorHeight, double ceilingHeight);
+bool wallBlocksMovement(int sector, const Wall& wall);
+// The portal on this wall's line, itself or a stacked copy, whose opening
+// spans height z (a point on its bottom edge goes through); -1 if z meets
+// solid wall there.
+int openingAtHeight(int sector, int wall, double z);
+// The same portal seen from the sector on the other side, or -1.
+int findBackWall(int sector, int wall);
+
 extern double posX, posY;
+extern double posZ; // feet height; picks the level where sectors are stacked
 extern double dirX, dirY;
 extern double planeX, planeY;
 
+// Snapshot of the player view, used to interpolate between simulation ticks.
+struct CameraState {
+    double posX, posY;
+    double dirX, dirY;
+    double planeX, planeY;
+};
+
+// Per-tick player input, one bit per action so demos store a byte per tick.
+enum {
+    INPUT_FORWARD = 1 << 0,
+    INPUT_BACK = 1 << 1,
+    INPUT_TURN_LEFT = 1 << 2,
+    INPUT_TURN_RIGHT = 1 << 3,
+    INPUT_USE = 1 << 4,
+    INPUT_FIRE = 1 << 5,
+};
+
+Uint8 sampleInput(const Uint8* keystate);
+
+CameraState captureCamera();
+void applyCamera(const CameraState& cam);
+CameraState interpolateCamera(const CameraState& a, const CameraState& b, double alpha);
+
+// Sectors may overlap in x/y when their height ranges don't (bridges,
+// balconies). The z form returns the containing sector with the highest
+// floor at or below z, or the lowest one above it if none is; the x/y
+// form returns the top one.
 int getSectorForPosition(double x, double y);
+int getSectorForPosition(double x, double y, double z);
+// Where someone standing at feetZ ends up after a move: anything they can
+// step onto. A NAN feetZ (not known yet) gives the top sector.
+int getSectorForFeet(double x, double y, double feetZ);
+// The height getSectorForFeet looks up from, and walkers cross lines at
+inline double feetProbeHeight(double feetZ) { return std::isnan(feetZ) ? INFINITY : feetZ + MAX_STEP_HEIGHT; }
 double pointToSegmentDistance(double px, double py, double x1, double y1, double x2, double y2);
-bool isMovementBlocked(double newX, double newY);
+const double COLLISION_RADIUS = 0.1;
+
+// With feetZ, walls of sectors whose height range the body doesn't reach are ignored.
+// throughLinks lets the body up to teleport walls, for the player who passes them.
+bool isMovementBlocked(double newX, double newY, double radius = COLLISION_RADIUS, double feetZ = NAN, bool throughLinks = false);
+bool segmentsIntersect(double ax, double ay, double bx, double by,
+                       double cx, double cy, double dx, double dy);
+// One portal a move went through: out of `from` by its wall `wall`, into `to`.
+struct SectorHop {
+    int from, wall, to;
+};
+const int MAX_SECTOR_HOPS = 4; // portals one move is followed through
+
+// The sector a short move from a known sector ends in, or -1 if it goes
+// through solid wall. z is the height the move crosses lines at, which
+// picks the opening on stacked lines: feetProbeHeight for walkers. With
+// hops, also each portal crossed on the way, in order, and their number
+// in hopCount.
+int updateSectorForMove(int sector, double oldX, double oldY, double newX, double newY, double z,
+                        SectorHop* hops = nullptr, int* hopCount = nullptr);
 bool intersectRayWithSegment(double rayX, double rayY, double rayDX, double rayDY,
                               double x1, double y1, double x2, double y2,
                               double& outDist);
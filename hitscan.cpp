@@ -0,0 +1,292 @@
+#include <iostream>
+#include <SDL2/SDL.h>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "helpers.h"
+#include "hitscan.h"
+#include "entities.h"
+#include "jobs.h"
+
+using namespace std;
+
+const int HITSCAN_MAX_HOPS = 64;
+const int HITSCAN_GRAIN = 16;
+
+// Where one ray is in its walk, plus the nearest entity seen so far
+struct RayWalk {
+    int sector;
+    double tEnter;
+    int hops;
+    double dx, dy; // normalized direction
+    double entityT;
+    int entity;
+};
+
+static bool startWalk(const RayQuery& q, RayWalk& w, RayHit& hit) {
+    hit.type = HIT_NONE;
+    hit.dist = q.maxDist;
+    hit.x = q.x;
+    hit.y = q.y;
+    hit.normalX = hit.normalY = 0.0;
+    hit.sector = q.sector;
+    hit.wall = -1;
+    hit.entity = -1;
+
+    double length = sqrt(q.dirX * q.dirX + q.dirY * q.dirY);
+    if (q.sector < 0 || q.sector >= (int)sectors.size() || length <= 0.0) return false;
+    w.sector = q.sector;
+    w.tEnter = 0.0;
+    w.hops = 0;
+    w.dx = q.dirX / length;
+    w.dy = q.dirY / length;
+    w.entityT = numeric_limits<double>::infinity();
+    w.entity = -1;
+    return true;
+}
+
+static void testEntities(const RayQuery& q, RayWalk& w) {
+    const vector<int>& start = sectorBuckets.sectorStart;
+    if (w.sector + 1 >= (int)start.size()) return;
+    for (int k = start[w.sector]; k < start[w.sector + 1]; k++) {
+        int e = sectorBuckets.sectorEntities[k];
+        if (e == q.ignoreEntity || !(entities.flags[e] & q.entityMask)) continue;
+        double ocx = entities.posX[e] - q.x, ocy = entities.posY[e] - q.y;
+        double r = entities.radius[e];
+        double b = ocx * w.dx + ocy * w.dy;
+        double c = ocx * ocx + ocy * ocy - r * r;
+        double disc = b * b - c;
+        if (disc < 0.0) continue;
+        double t = b - sqrt(disc);
+        if (t < 0.0) {
+            if (c > 0.0) continue; // circle is behind the origin
+            t = 0.0;               // origin is inside it
+        }
+        if (t < w.entityT) {
+            w.entityT = t;
+            w.entity = e;
+        }
+    }
+}
+
+// Resolves the sector just tested: an entity before the exit, a wall,
+// out of range, or on through a portal. True once the hit is final.
+static bool leaveSector(const RayQuery& q, RayWalk& w, int exitWall, double exitT, RayHit& hit) {
+    double limit = min(exitT, q.maxDist);
+    if (w.entity >= 0 && w.entityT <= limit) {
+        hit.type = HIT_ENTITY;
+        hit.dist = w.entityT;
+        hit.x = q.x + w.dx * w.entityT;
+        hit.y = q.y + w.dy * w.entityT;
+        double nx = hit.x - entities.posX[w.entity], ny = hit.y - entities.posY[w.entity];
+        double nl = sqrt(nx * nx + ny * ny);
+        if (nl > 0.0) {
+            hit.normalX = nx / nl;
+            hit.normalY = ny / nl;
+        } else {
+            hit.normalX = -w.dx;
+            hit.normalY = -w.dy;
+        }
+        hit.sector = entities.sector[w.entity];
+        hit.entity = w.entity;
+        return true;
+    }
+    if (exitWall < 0 || exitT > q.maxDist) {
+        hit.x = q.x + w.dx * q.maxDist;
+        hit.y = q.y + w.dy * q.maxDist;
+        return true;
+    }
+
+    const Sector& sector = sectors[w.sector];
+    const Wall& wall = sector.walls[exitWall];
+    // Stacked copies share the exit t; take the opening at the ray's height
+    int through = openingAtHeight(w.sector, exitWall, q.z);
+    if (through < 0) {
+        hit.type = HIT_WALL;
+        hit.dist = exitT;
+        hit.x = q.x + w.dx * exitT;
+        hit.y = q.y + w.dy * exitT;
+        double sx = wall.x2 - wall.x1, sy = wall.y2 - wall.y1;
+        double sl = sqrt(sx * sx + sy * sy);
+        hit.normalX = -sy / sl;
+        hit.normalY = sx / sl;
+        if (hit.normalX * w.dx + hit.normalY * w.dy > 0.0) {
+            hit.normalX = -hit.normalX;
+            hit.normalY = -hit.normalY;
+        }
+        hit.sector = w.sector;
+        hit.wall = exitWall;
+        return true;
+    }
+
+    w.sector = sector.walls[through].adjoiningSector;
+    w.tEnter = exitT;
+    if (++w.hops >= HITSCAN_MAX_HOPS) {
+        hit.x = q.x + w.dx * exitT;
+        hit.y = q.y + w.dy * exitT;
+        return true;
+    }
+    return false;
+}
+
+static bool stepRay(const RayQuery& q, RayWalk& w, RayHit& hit) {
+    const vector<Wall>& walls = sectors[w.sector].walls;
+    int exitWall = -1;
+    double exitT = numeric_limits<double>::infinity();
+    for (int i = 0; i < (int)walls.size(); i++) {
+        const Wall& wall = walls[i];
+        double sx = wall.x2 - wall.x1, sy = wall.y2 - wall.y1;
+        double denom = w.dx * sy - w.dy * sx;
+        if (fabs(denom) < 1e-12) continue;
+        double wx = wall.x1 - q.x, wy = wall.y1 - q.y;
+        double t = (wx * sy - wy * sx) / denom;
+        double u = (wx * w.dy - wy * w.dx) / denom;
+        if (u < 0.0 || u > 1.0 || t <= w.tEnter + 1e-9 || t >= exitT) continue;
+        exitT = t;
+        exitWall = i;
+    }
+    testEntities(q, w);
+    return leaveSector(q, w, exitWall, exitT, hit);
+}
+
+bool castRay(const RayQuery& query, RayHit& hit) {
+    RayWalk w;
+    if (!startWalk(query, w, hit)) return false;
+    while (!stepRay(query, w, hit)) {}
+    return hit.type != HIT_NONE;
+}
+
+// Two rays from the same point. Wall and entity tests run both lanes at
+// once for as long as the rays are in the same sector; after they split
+// each finishes on its own.
+static void castRayPair(const RayQuery& qa, const RayQuery& qb, RayHit& ha, RayHit& hb) {
+    RayWalk wa, wb;
+    bool activeA = startWalk(qa, wa, ha);
+    bool activeB = startWalk(qb, wb, hb);
+
+#ifdef __SSE2__
+    const __m128d absMask = _mm_castsi128_pd(_mm_set1_epi64x(0x7FFFFFFFFFFFFFFFll));
+    const __m128d epsilon = _mm_set1_pd(1e-12);
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d one = _mm_set1_pd(1.0);
+    while (activeA && activeB && wa.sector == wb.sector) {
+        __m128d dx = _mm_set_pd(wb.dx, wa.dx);
+        __m128d dy = _mm_set_pd(wb.dy, wa.dy);
+        __m128d enter = _mm_add_pd(_mm_set_pd(wb.tEnter, wa.tEnter), _mm_set1_pd(1e-9));
+        __m128d exitT = _mm_set1_pd(numeric_limits<double>::infinity());
+        int exitWall[2] = { -1, -1 };
+
+        const vector<Wall>& walls = sectors[wa.sector].walls;
+        for (int i = 0; i < (int)walls.size(); i++) {
+            const Wall& wall = walls[i];
+            __m128d sx = _mm_set1_pd(wall.x2 - wall.x1), sy = _mm_set1_pd(wall.y2 - wall.y1);
+            __m128d wx = _mm_set1_pd(wall.x1 - qa.x), wy = _mm_set1_pd(wall.y1 - qa.y);
+            __m128d denom = _mm_sub_pd(_mm_mul_pd(dx, sy), _mm_mul_pd(dy, sx));
+            __m128d t = _mm_div_pd(_mm_sub_pd(_mm_mul_pd(wx, sy), _mm_mul_pd(wy, sx)), denom);
+            __m128d u = _mm_div_pd(_mm_sub_pd(_mm_mul_pd(wx, dy), _mm_mul_pd(wy, dx)), denom);
+            __m128d valid = _mm_cmpge_pd(_mm_and_pd(denom, absMask), epsilon);
+            valid = _mm_and_pd(valid, _mm_and_pd(_mm_cmpge_pd(u, zero), _mm_cmple_pd(u, one)));
+            valid = _mm_and_pd(valid, _mm_and_pd(_mm_cmpgt_pd(t, enter), _mm_cmplt_pd(t, exitT)));
+            int mask = _mm_movemask_pd(valid);
+            if (!mask) continue;
+            exitT = _mm_or_pd(_mm_and_pd(valid, t), _mm_andnot_pd(valid, exitT));
+            if (mask & 1) exitWall[0] = i;
+            if (mask & 2) exitWall[1] = i;
+        }
+
+        const vector<int>& start = sectorBuckets.sectorStart;
+        if (wa.sector + 1 < (int)start.size()) {
+            for (int k = start[wa.sector]; k < start[wa.sector + 1]; k++) {
+                int e = sectorBuckets.sectorEntities[k];
+                bool testA = e != qa.ignoreEntity && (entities.flags[e] & qa.entityMask);
+                bool testB = e != qb.ignoreEntity && (entities.flags[e] & qb.entityMask);
+                if (!testA && !testB) continue;
+                double ocx = entities.posX[e] - qa.x, ocy = entities.posY[e] - qa.y;
+                double r = entities.radius[e];
+                double c = ocx * ocx + ocy * ocy - r * r;
+                __m128d b = _mm_add_pd(_mm_mul_pd(_mm_set1_pd(ocx), dx), _mm_mul_pd(_mm_set1_pd(ocy), dy));
+                __m128d disc = _mm_sub_pd(_mm_mul_pd(b, b), _mm_set1_pd(c));
+                __m128d t = _mm_sub_pd(b, _mm_sqrt_pd(_mm_max_pd(disc, zero)));
+                int hitMask = _mm_movemask_pd(_mm_cmpge_pd(disc, zero));
+                double lanes[2];
+                _mm_storeu_pd(lanes, t);
+                RayWalk* walk[2] = { &wa, &wb };
+                bool test[2] = { testA, testB };
+                for (int lane = 0; lane < 2; lane++) {
+                    if (!test[lane] || !(hitMask & (1 << lane))) continue;
+                    double tl = lanes[lane];
+                    if (tl < 0.0) {
+                        if (c > 0.0) continue;
+                        tl = 0.0;
+                    }
+                    if (tl < walk[lane]->entityT) {
+                        walk[lane]->entityT = tl;
+                        walk[lane]->entity = e;
+                    }
+                }
+            }
+        }
+
+        double exits[2];
+        _mm_storeu_pd(exits, exitT);
+        activeA = !leaveSector(qa, wa, exitWall[0], exits[0], ha);
+        activeB = !leaveSector(qb, wb, exitWall[1], exits[1], hb);
+    }
+#endif
+    while (activeA) activeA = !stepRay(qa, wa, ha);
+    while (activeB) activeB = !stepRay(qb, wb, hb);
+}
+
+void castRays(const RayQuery* queries, int count, RayHit* hits) {
+    if (count <= 0) return;
+
+    // Sort by origin so rays fired together (a shotgun blast) sit next to
+    // each other, then pair up neighbours with the same origin
+    static thread_local vector<int> order;
+    static thread_local vector<int> packets; // first query index of each packet, -1 marks a single
+    order.resize(count);
+    for (int i = 0; i < count; i++) order[i] = i;
+    sort(order.begin(), order.end(), [&](int a, int b) {
+        const RayQuery& qa = queries[a];
+        const RayQuery& qb = queries[b];
+        if (qa.sector != qb.sector) return qa.sector < qb.sector;
+        if (qa.x != qb.x) return qa.x < qb.x;
+        if (qa.y != qb.y) return qa.y < qb.y;
+        if (qa.z != qb.z) return qa.z < qb.z;
+        return a < b;
+    });
+
+    packets.clear();
+    for (int i = 0; i < count;) {
+        const RayQuery& q = queries[order[i]];
+        if (i + 1 < count) {
+            const RayQuery& n = queries[order[i + 1]];
+            if (n.sector == q.sector && n.x == q.x && n.y == q.y && n.z == q.z) {
+                packets.push_back(i);
+                i += 2;
+                continue;
+            }
+        }
+        packets.push_back(-1 - i);
+        i++;
+    }
+
+    // Workers see their own thread_local copies, so hand them this thread's
+    const vector<int>& sorted = order;
+    const vector<int>& runs = packets;
+    parallelFor(0, (int)runs.size(), HITSCAN_GRAIN, [&](int first, int last) {
+        for (int p = first; p < last; p++) {
+            if (runs[p] >= 0) {
+                int a = sorted[runs[p]], b = sorted[runs[p] + 1];
+                castRayPair(queries[a], queries[b], hits[a], hits[b]);
+            } else {
+                int a = sorted[-1 - runs[p]];
+                castRay(queries[a], hits[a]);
+            }
+        }
+    });
+}
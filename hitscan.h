@@ -0,0 +1,43 @@
+// hitscan.h
+#ifndef HITSCAN_H
+#define HITSCAN_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+
+// Horizontal rays for weapons. Each ray walks the portal graph from its
+// sector the way hasLineOfSight does, and tests entity circles only in
+// the sectors it passes through. z decides whether a portal's opening
+// lets the ray through or it hits the step or lintel.
+struct RayQuery {
+    int sector;
+    double x, y, z;
+    double dirX, dirY;  // need not be normalized
+    double maxDist;
+    Uint32 entityMask;  // entities with any of these flags can be hit
+    int ignoreEntity;   // the shooter, or -1
+};
+
+enum {
+    HIT_NONE = 0,
+    HIT_WALL = 1,
+    HIT_ENTITY = 2,
+};
+
+struct RayHit {
+    int type;
+    double dist;             // along the normalized direction
+    double x, y;
+    double normalX, normalY; // unit, facing back along the ray
+    int sector;              // sector the hit is in
+    int wall;                // wall index in that sector, for HIT_WALL
+    int entity;              // for HIT_ENTITY
+};
+
+bool castRay(const RayQuery& query, RayHit& hit);
+
+// Rays that share an origin are walked in SSE2 pairs while they stay in
+// the same sector; the batch is spread over the job system.
+void castRays(const RayQuery* queries, int count, RayHit* hits);
+
+#endif
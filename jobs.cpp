@@ -0,0 +1,204 @@
+#include <SDL2/SDL.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include "jobs.h"
+
+using namespace std;
+
+struct Job {
+    function<void()> fn;
+    atomic<int> pendingDeps{1}; // held at 1 by jobsSubmit until deps are linked
+    atomic<bool> done{false};
+    mutex continuationMutex;
+    vector<JobHandle> continuations;
+};
+
+struct WorkerQueue {
+    mutex m;
+    deque<JobHandle> jobs;
+};
+
+static vector<thread> workers;
+static vector<unique_ptr<WorkerQueue>> queues; // one per worker, plus one for outside threads
+static atomic<int> queuedJobs{0};
+static atomic<bool> stopping{false};
+static bool participate = true;
+static mutex wakeMutex;
+static condition_variable wakeCv;
+static condition_variable doneCv;
+static thread_local int queueIndex = -1;
+
+static int ownQueue() {
+    // Threads outside the pool (the main thread, SDL callbacks) share the last queue
+    return queueIndex >= 0 ? queueIndex : (int)queues.size() - 1;
+}
+
+static void enqueue(const JobHandle& job) {
+    WorkerQueue& q = *queues[ownQueue()];
+    {
+        lock_guard<mutex> lock(q.m);
+        q.jobs.push_back(job);
+    }
+    queuedJobs++;
+    lock_guard<mutex> lock(wakeMutex);
+    wakeCv.notify_one();
+}
+
+static JobHandle takeJob() {
+    int own = ownQueue();
+    {
+        WorkerQueue& q = *queues[own];
+        lock_guard<mutex> lock(q.m);
+        if (!q.jobs.empty()) {
+            JobHandle job = q.jobs.back();
+            q.jobs.pop_back();
+            queuedJobs--;
+            return job;
+        }
+    }
+    int count = (int)queues.size();
+    for (int i = 1; i < count; i++) {
+        WorkerQueue& q = *queues[(own + i) % count];
+        lock_guard<mutex> lock(q.m);
+        if (!q.jobs.empty()) {
+            JobHandle job = q.jobs.front();
+            q.jobs.pop_front();
+            queuedJobs--;
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+static void runJob(const JobHandle& job) {
+    job->fn();
+
+    vector<JobHandle> ready;
+    {
+        lock_guard<mutex> lock(job->continuationMutex);
+        job->done = true;
+        ready.swap(job->continuations);
+    }
+    for (const JobHandle& next : ready) {
+        if (--next->pendingDeps == 0) enqueue(next);
+    }
+
+    lock_guard<mutex> lock(wakeMutex);
+    doneCv.notify_all();
+}
+
+static bool runOneJob() {
+    JobHandle job = takeJob();
+    if (!job) return false;
+    runJob(job);
+    return true;
+}
+
+static void workerLoop(int index) {
+    queueIndex = index;
+    while (!stopping) {
+        if (runOneJob()) continue;
+        unique_lock<mutex> lock(wakeMutex);
+        wakeCv.wait(lock, [] { return stopping || queuedJobs > 0; });
+    }
+}
+
+void jobsInit(int workerCount) {
+    if (!queues.empty()) return;
+    if (workerCount < 0) workerCount = max(0, SDL_GetCPUCount() - 1);
+
+    stopping = false;
+    for (int i = 0; i <= workerCount; i++) queues.push_back(make_unique<WorkerQueue>());
+    for (int i = 0; i < workerCount; i++) workers.emplace_back(workerLoop, i);
+}
+
+void jobsShutdown() {
+    if (queues.empty()) return;
+    {
+        lock_guard<mutex> lock(wakeMutex);
+        stopping = true;
+        wakeCv.notify_all();
+    }
+    for (thread& t : workers) t.join();
+    workers.clear();
+
+    // Anything still queued runs here so nobody waits on it forever
+    while (runOneJob()) {}
+    queues.clear();
+}
+
+int jobsWorkerCount() {
+    return (int)workers.size();
+}
+
+void jobsSetMainThreadParticipation(bool p) {
+    participate = p;
+}
+
+JobHandle jobsSubmit(function<void()> fn, const vector<JobHandle>& deps) {
+    JobHandle job = make_shared<Job>();
+    job->fn = move(fn);
+
+    if (queues.empty()) {
+        // Scheduler not running: deps have already completed inline
+        runJob(job);
+        return job;
+    }
+
+    for (const JobHandle& dep : deps) {
+        if (!dep) continue;
+        lock_guard<mutex> lock(dep->continuationMutex);
+        if (!dep->done) {
+            job->pendingDeps++;
+            dep->continuations.push_back(job);
+        }
+    }
+    if (--job->pendingDeps == 0) enqueue(job);
+    return job;
+}
+
+bool jobsDone(const JobHandle& job) {
+    return !job || job->done;
+}
+
+void jobsWait(const JobHandle& job) {
+    bool help = participate || workers.empty() || queueIndex >= 0;
+    while (!jobsDone(job)) {
+        if (help && runOneJob()) continue;
+        unique_lock<mutex> lock(wakeMutex);
+        doneCv.wait_for(lock, chrono::milliseconds(1), [&] { return job->done.load(); });
+    }
+}
+
+void parallelFor(int begin, int end, int grain, const function<void(int, int)>& body) {
+    if (end <= begin) return;
+    if (grain < 1) grain = 1;
+    int chunks = (end - begin + grain - 1) / grain;
+    int helpers = min(chunks - 1, (int)workers.size());
+    if (helpers <= 0) {
+        body(begin, end);
+        return;
+    }
+
+    // Chunks are claimed from a shared counter, so faster threads take more
+    atomic<int> nextChunk{0};
+    auto work = [&] {
+        while (true) {
+            int chunk = nextChunk++;
+            if (chunk >= chunks) break;
+            int chunkBegin = begin + chunk * grain;
+            body(chunkBegin, min(end, chunkBegin + grain));
+        }
+    };
+
+    vector<JobHandle> spawned;
+    for (int i = 0; i < helpers; i++) spawned.push_back(jobsSubmit(work));
+    work();
+    for (const JobHandle& job : spawned) jobsWait(job);
+}
@@ -0,0 +1,34 @@
+// jobs.h
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Shared work-stealing scheduler. Each worker owns a deque: it pushes and
+// pops its own jobs from the back and steals from the front of others.
+// Everything that wants parallelism goes through here so subsystems never
+// spin up their own threads and oversubscribe the cores.
+struct Job;
+typedef std::shared_ptr<Job> JobHandle;
+
+// workerCount < 0 picks one worker per core, minus the calling thread.
+void jobsInit(int workerCount = -1);
+void jobsShutdown();
+int jobsWorkerCount();
+
+// When enabled (the default) a thread blocked in jobsWait or parallelFor
+// runs queued jobs instead of sleeping. It is always on with zero workers.
+void jobsSetMainThreadParticipation(bool participate);
+
+// The job only becomes runnable once every job in deps has finished.
+JobHandle jobsSubmit(std::function<void()> fn, const std::vector<JobHandle>& deps = {});
+bool jobsDone(const JobHandle& job);
+void jobsWait(const JobHandle& job);
+
+// Runs body(chunkBegin, chunkEnd) over [begin, end) in chunks of `grain`
+// and returns when all of them are done. The caller works on chunks too.
+void parallelFor(int begin, int end, int grain, const std::function<void(int, int)>& body);
+
+#endif
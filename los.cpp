@@ -0,0 +1,128 @@
+#include <iostream>
+#include <SDL2/SDL.h>
+#include <vector>
+#include <atomic>
+#include <cmath>
+#include <algorithm>
+#include "helpers.h"
+#include "los.h"
+#include "jobs.h"
+
+using namespace std;
+
+vector<int> sectorComponent;
+
+const int LOS_MAX_HOPS = 64;
+const int LOS_GRAIN = 64;
+const double LOS_CACHE_QUANTUM = 1.0 / 32.0; // endpoints this close share a result
+const int LOS_CACHE_BITS = 14;
+
+// Each slot packs the key hash, the tick it was written and the result
+// into one word so parallel queries can share the cache without locks.
+static atomic<Uint64> losCache[1 << LOS_CACHE_BITS];
+static Uint32 losTick = 1;
+
+void buildSectorReachability() {
+    int count = (int)sectors.size();
+    sectorComponent.assign(count, -1);
+
+    int component = 0;
+    vector<int> stack;
+    for (int start = 0; start < count; start++) {
+        if (sectorComponent[start] >= 0) continue;
+        sectorComponent[start] = component;
+        stack.push_back(start);
+        while (!stack.empty()) {
+            int s = stack.back();
+            stack.pop_back();
+            for (const Wall& wall : sectors[s].walls) {
+                int n = wall.adjoiningSector;
+                if (!wall.isPortal || n < 0 || n >= count || sectorComponent[n] >= 0) continue;
+                sectorComponent[n] = component;
+                stack.push_back(n);
+            }
+        }
+        component++;
+    }
+}
+
+void losBeginTick() {
+    // Tick 0 is never current, so zeroed slots always miss
+    losTick = (losTick + 1) & 0x7FFFFF;
+    if (losTick == 0) losTick = 1;
+}
+
+static Uint64 hashQuery(const LosQuery& q) {
+    Sint64 parts[8] = {
+        q.sectorA, q.sectorB,
+        llround(q.ax / LOS_CACHE_QUANTUM), llround(q.ay / LOS_CACHE_QUANTUM), llround(q.az / LOS_CACHE_QUANTUM),
+        llround(q.bx / LOS_CACHE_QUANTUM), llround(q.by / LOS_CACHE_QUANTUM), llround(q.bz / LOS_CACHE_QUANTUM),
+    };
+    Uint64 h = 1469598103934665603ull;
+    for (Sint64 part : parts) {
+        h ^= (Uint64)part;
+        h *= 1099511628211ull;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+static bool walkLineOfSight(const LosQuery& q) {
+    int sector = q.sectorA;
+    double tEnter = 0.0;
+    double dx = q.bx - q.ax, dy = q.by - q.ay;
+
+    for (int hop = 0; hop < LOS_MAX_HOPS; hop++) {
+        if (sector == q.sectorB) return true;
+
+        // Nearest wall of this sector the segment leaves through
+        int exitWall = -1;
+        double exitT = 2.0;
+        const vector<Wall>& walls = sectors[sector].walls;
+        for (int i = 0; i < (int)walls.size(); i++) {
+            const Wall& wall = walls[i];
+            double sx = wall.x2 - wall.x1, sy = wall.y2 - wall.y1;
+            double denom = dx * sy - dy * sx;
+            if (fabs(denom) < 1e-12) continue;
+            double t = ((wall.x1 - q.ax) * sy - (wall.y1 - q.ay) * sx) / denom;
+            double u = ((wall.x1 - q.ax) * dy - (wall.y1 - q.ay) * dx) / denom;
+            if (u < 0.0 || u > 1.0 || t <= tEnter + 1e-9 || t >= exitT) continue;
+            exitT = t;
+            exitWall = i;
+        }
+
+        // Reached B without leaving the sector we're in
+        if (exitWall < 0 || exitT > 1.0) return true;
+
+        // The sight line must pass through an opening between the two
+        // sectors; on a stacked line, the one at its height
+        int through = openingAtHeight(sector, exitWall, q.az + (q.bz - q.az) * exitT);
+        if (through < 0) return false;
+
+        sector = walls[through].adjoiningSector;
+        tEnter = exitT;
+    }
+    return false;
+}
+
+bool hasLineOfSight(const LosQuery& q) {
+    int count = (int)sectors.size();
+    if (q.sectorA < 0 || q.sectorA >= count || q.sectorB < 0 || q.sectorB >= count) return false;
+    if ((int)sectorComponent.size() == count && sectorComponent[q.sectorA] != sectorComponent[q.sectorB]) return false;
+
+    Uint64 hash = hashQuery(q);
+    atomic<Uint64>& slot = losCache[hash & ((1 << LOS_CACHE_BITS) - 1)];
+    Uint64 tag = hash >> 24;
+    Uint64 entry = slot.load(memory_order_relaxed);
+    if ((entry >> 24) == tag && ((entry >> 1) & 0x7FFFFF) == losTick) return (entry & 1) != 0;
+
+    bool visible = walkLineOfSight(q);
+    slot.store((tag << 24) | ((Uint64)losTick << 1) | (visible ? 1 : 0), memory_order_relaxed);
+    return visible;
+}
+
+void checkLinesOfSight(const LosQuery* queries, int count, Uint8* outVisible) {
+    parallelFor(0, count, LOS_GRAIN, [&](int first, int last) {
+        for (int i = first; i < last; i++) outVisible[i] = hasLineOfSight(queries[i]) ? 1 : 0;
+    });
+}
@@ -0,0 +1,30 @@
+// los.h
+#ifndef LOS_H
+#define LOS_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+
+// Line of sight by walking the portal graph along the segment A -> B,
+// instead of scanning every wall the way the renderer does.
+struct LosQuery {
+    int sectorA;
+    double ax, ay, az;
+    int sectorB;
+    double bx, by, bz;
+};
+
+// Sector -> connected component over every portal, shut doors included
+// since they can open. Sectors in different components can never see
+// each other.
+extern std::vector<int> sectorComponent;
+
+void buildSectorReachability();
+
+// Results are cached per (sector pair, endpoints) until the next tick.
+void losBeginTick();
+
+bool hasLineOfSight(const LosQuery& query);
+void checkLinesOfSight(const LosQuery* queries, int count, Uint8* outVisible);
+
+#endif
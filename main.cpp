@@ -3,175 +3,487 @@
 #include <vector>
 #include <cmath>
 #include <limits>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
 #include "helpers.h"
+#include "profiler.h"
+#include "demo.h"
+#include "jobs.h"
+#include "entities.h"
+#include "render.h"
+#include "los.h"
+#include "movers.h"
+#include "polyobj.h"
+#include "hitscan.h"
+#include "noise.h"
+#include "ai.h"
+#include "particles.h"
+#include "audio.h"
+#include "triggers.h"
+#include "portals.h"
+#include "proximity.h"
 
 using namespace std;
 
-const int SCREEN_WIDTH = 1080;
-const int SCREEN_HEIGHT = 720;
-const double playerEyeHeightOffset = 1.0; 
-
-void renderFrame(SDL_Surface* surface) {
-    int playerSector = getSectorForPosition(posX, posY);
-    if (playerSector == -1) return;
-
-    double playerHeight = sectors[playerSector].floorHeight + playerEyeHeightOffset;
-
-    for (int x = 0; x < SCREEN_WIDTH; x++) {
-        double cameraX = 2.0 * x / SCREEN_WIDTH - 1;
-        double rayDirX = dirX + planeX * cameraX;
-        double rayDirY = dirY + planeY * cameraX;
-
-        double rayX = posX, rayY = posY;
-
-        double totalDist = 0.0;
-        const int MAX_PORTAL_DEPTH = 10;
-
-        int currentSector = playerSector;
-
-        // Instead of only one sector, we try to find closest wall in all sectors at each step
-        for (int depth = 0; depth < MAX_PORTAL_DEPTH; ++depth) {
-            double closestDist = numeric_limits<double>::infinity();
-            Wall* hitWall = nullptr;
-            int hitSectorIndex = -1;
-
-            // Test ray against all sectors (not just currentSector)
-            for (int si = 0; si < (int)sectors.size(); si++) {
-                Sector* sector = &sectors[si];
-                for (Wall& wall : sector->walls) {
-                    double dist;
-                    if (intersectRayWithSegment(rayX, rayY, rayDirX, rayDirY,
-                                                wall.x1, wall.y1, wall.x2, wall.y2, dist)) {
-                        if (dist < closestDist) {
-                            closestDist = dist;
-                            hitWall = &wall;
-                            hitSectorIndex = si;
-                        }
-                    }
-                }
-            }
-
-            if (!hitWall) break;
-
-            totalDist += closestDist;
+// Simulation runs on a fixed clock; rendering interpolates between ticks.
+const double TICK_RATE = 120.0;
+const double TICK_DT = 1.0 / TICK_RATE;
+const double MAX_FRAME_TIME = 0.25; // clamp after stalls so we don't spiral
+const double TARGET_FRAME_TIME = 1.0 / 60.0;
+
+// Late-latch mode sleeps before sampling input instead of after present,
+// leaving just enough time for the predicted simulate+render cost.
+const double LATE_LATCH_MARGIN_MS = 1.5;
+const double WORK_ESTIMATE_BLEND = 0.1;
+const double PROFILE_REPORT_INTERVAL = 5.0;
+const unsigned SPAWN_SEED = 1234; // --spawn scatter; demos store the seed they were recorded with
+
+// Speeds are per second; one tick applies dt worth of movement.
+const double moveSpeed = 12.0;
+const double rotSpeed = 6.0;
+
+// Shotgun: a fan of hitscan pellets, each one kills the first monster it reaches
+const double FIRE_INTERVAL = 0.25;
+const int PELLET_COUNT = 8;
+const double PELLET_SPREAD = 0.1; // radians across the whole fan
+const double WEAPON_RANGE = 64.0;
+const double GUNSHOT_LOUDNESS = 40.0;
+const int IMPACT_PARTICLES = 24; // per pellet hit
+const double AUTOAIM_ANGLE = 0.1;   // radians either side of the view a monster pulls the fan onto itself
+
+double aiBudgetUs = AI_BUDGET_US;
+
+// One axis at a time so the player slides along walls; a step through a
+// teleport ends the move on the far side
+static void movePlayer(double newX, double newY) {
+    if (passPortalLink(newX, posY)) return;
+    if (!isMovementBlocked(newX, posY, COLLISION_RADIUS, posZ, true)) posX = newX;
+    if (passPortalLink(posX, newY)) return;
+    if (!isMovementBlocked(posX, newY, COLLISION_RADIUS, posZ, true)) posY = newY;
+}
 
-            Sector* sector = &sectors[hitSectorIndex];
-            double floorHeight = sector->floorHeight;
-            double ceilingHeight = sector->ceilingHeight;
+void updatePlayer(Uint8 buttons, double dt) {
+    double step = moveSpeed * dt;
+    double angle = rotSpeed * dt;
+
+    if (buttons & INPUT_FORWARD) movePlayer(posX + dirX * step, posY + dirY * step);
+    if (buttons & INPUT_BACK) movePlayer(posX - dirX * step, posY - dirY * step);
+    if (buttons & INPUT_TURN_LEFT) {
+        double oldDirX = dirX;
+        dirX = dirX * cos(angle) - dirY * sin(angle);
+        dirY = oldDirX * sin(angle) + dirY * cos(angle);
+        double oldPlaneX = planeX;
+        planeX = planeX * cos(angle) - planeY * sin(angle);
+        planeY = oldPlaneX * sin(angle) + planeY * cos(angle);
+    }
+    if (buttons & INPUT_TURN_RIGHT) {
+        double oldDirX = dirX;
+        dirX = dirX * cos(-angle) - dirY * sin(-angle);
+        dirY = oldDirX * sin(-angle) + dirY * cos(-angle);
+        double oldPlaneX = planeX;
+        planeX = planeX * cos(-angle) - planeY * sin(-angle);
+        planeY = oldPlaneX * sin(-angle) + planeY * cos(-angle);
+    }
+}
 
-            int ceilingScreenY = (int)((SCREEN_HEIGHT / 2.0) - (ceilingHeight - playerHeight) * SCREEN_HEIGHT / totalDist);
-            int floorScreenY = (int)((SCREEN_HEIGHT / 2.0) + (playerHeight - floorHeight) * SCREEN_HEIGHT / totalDist);
+// Centers the fan on the nearest monster in sight close to the view
+// direction, or leaves it straight ahead
+static void autoAim(int sector, double eyeZ, double& aimX, double& aimY) {
+    aimX = dirX;
+    aimY = dirY;
+    RadiusQuery q = { sector, posX, posY, eyeZ, WEAPON_RANGE, ENTITY_MONSTER, true };
+    static vector<EntityNear> inRange;
+    queryEntitiesInRadius(q, inRange);
+
+    double viewLength = hypot(dirX, dirY);
+    for (const EntityNear& n : inRange) {
+        double tx = entities.posX[n.entity] - posX, ty = entities.posY[n.entity] - posY;
+        double length = hypot(tx, ty);
+        if (length < 1e-9 || (tx * dirX + ty * dirY) < cos(AUTOAIM_ANGLE) * length * viewLength) continue;
+        aimX = tx / length * viewLength;
+        aimY = ty / length * viewLength;
+        return;
+    }
+}
 
-            ceilingScreenY = max(0, ceilingScreenY);
-            floorScreenY = min(SCREEN_HEIGHT - 1, floorScreenY);
+void fireWeapon() {
+    int sector = getSectorForFeet(posX, posY, posZ);
+    if (sector < 0) return;
+
+    RayQuery queries[PELLET_COUNT];
+    RayHit hits[PELLET_COUNT];
+    double eyeZ = sectors[sector].floorHeight + playerEyeHeightOffset;
+    double aimX, aimY;
+    autoAim(sector, eyeZ, aimX, aimY);
+    for (int p = 0; p < PELLET_COUNT; p++) {
+        double angle = ((double)p / (PELLET_COUNT - 1) - 0.5) * PELLET_SPREAD;
+        double dx = aimX * cos(angle) - aimY * sin(angle);
+        double dy = aimX * sin(angle) + aimY * cos(angle);
+        queries[p] = { sector, posX, posY, eyeZ, dx, dy, WEAPON_RANGE, ENTITY_MONSTER, -1 };
+    }
+    castRays(queries, PELLET_COUNT, hits);
+    playSound(SOUND_SHOTGUN, sector, posX, posY, 1.0);
+
+    int nearestWall = -1;
+    for (int p = 0; p < PELLET_COUNT; p++) {
+        const RayHit& hit = hits[p];
+        if (hit.type == HIT_WALL) {
+            if (nearestWall < 0 || hit.dist < hits[nearestWall].dist) nearestWall = p;
+            emitParticles(IMPACT_PARTICLES, hit.sector, hit.x + hit.normalX * 0.01, hit.y + hit.normalY * 0.01, eyeZ,
+                          hit.normalX, hit.normalY, 0.5, 3.0, 0.6, 0.6, PARTICLE_SPARK);
+        } else if (hit.type == HIT_ENTITY) {
+            emitParticles(IMPACT_PARTICLES, hit.sector, hit.x, hit.y, eyeZ,
+                          queries[p].dirX, queries[p].dirY, 0.3, 2.0, 0.8, 1.0, PARTICLE_BLOOD);
+        }
+    }
+    if (nearestWall >= 0) {
+        const RayHit& hit = hits[nearestWall];
+        playSound(SOUND_IMPACT, hit.sector, hit.x, hit.y, 0.6);
+    }
 
-            drawVerticalLine(surface, x, 0, ceilingScreenY, SDL_MapRGB(surface->format, 100, 100, 255));
+    // Highest index first, so swap-and-pop never moves one still to be removed
+    vector<int> killed;
+    for (const RayHit& hit : hits) {
+        if (hit.type == HIT_ENTITY) killed.push_back(hit.entity);
+    }
+    sort(killed.begin(), killed.end());
+    killed.erase(unique(killed.begin(), killed.end()), killed.end());
+    for (int k = (int)killed.size() - 1; k >= 0; k--) removeEntity(killed[k]);
+    if (!killed.empty()) rebuildSectorBuckets();
 
-            int lineHeight = (int)(SCREEN_HEIGHT / totalDist);
-            int drawStart = ceilingScreenY;
-            int drawEnd = floorScreenY;
-            if (drawEnd < drawStart) {
-                drawStart = max(0, SCREEN_HEIGHT / 2 - lineHeight / 2);
-                drawEnd = min(SCREEN_HEIGHT - 1, drawStart + lineHeight);
-            }
+    emitNoise(sector, posX, posY, GUNSHOT_LOUDNESS);
+}
 
-            Uint32 wallColor = SDL_MapRGB(surface->format,
-                                          hitWall->isPortal ? 0 : 255, 105, 180);
-            drawVerticalLine(surface, x, drawStart, drawEnd, wallColor);
+// One fixed step of the whole simulation.
+void simulateTick(Uint8 buttons) {
+    static Uint8 lastButtons = 0;
+    static int fireCooldown = 0; // ticks until the weapon can fire again
+    losBeginTick();
+    // Use fires on the press, not for every tick the key is held
+    if ((buttons & INPUT_USE) && !(lastButtons & INPUT_USE)) useFromPosition(posX, posY, dirX, dirY);
+    lastButtons = buttons;
+    if (fireCooldown > 0) fireCooldown--;
+    if ((buttons & INPUT_FIRE) && fireCooldown == 0) {
+        fireWeapon();
+        fireCooldown = (int)(FIRE_INTERVAL * TICK_RATE);
+    }
+    updateMovers(TICK_DT);
+    updatePolyobjs(TICK_DT);
+    double oldX = posX, oldY = posY;
+    Uint32 passes = linkPasses;
+    updatePlayer(buttons, TICK_DT);
+    // Settle onto whatever level the move stepped onto
+    int playerSector = getSectorForFeet(posX, posY, posZ);
+    if (playerSector >= 0) posZ = sectors[playerSector].floorHeight;
+    // Across a link the old and new positions aren't one segment of the map
+    if (linkPasses != passes) triggersPlayerTeleported();
+    else triggersPlayerMoved(oldX, oldY, posX, posY);
+    aiUpdate(aiBudgetUs);
+    updateEntities(TICK_DT);
+    triggersEntitiesMoved();
+    updateParticles(TICK_DT);
+}
 
-            drawVerticalLine(surface, x, floorScreenY, SCREEN_HEIGHT, SDL_MapRGB(surface->format, 100, 255, 100));
+// Sleep most of the remaining budget, then spin the last bit since
+// SDL_Delay only has millisecond granularity.
+void waitUntil(Uint64 deadline) {
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    while (true) {
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (now >= deadline) break;
+        double remainingMs = (deadline - now) * 1000.0 / freq;
+        if (remainingMs > 2.0) SDL_Delay((Uint32)(remainingMs - 1.0));
+    }
+}
 
-            if (!hitWall->isPortal) break;
+// Replays a demo one tick per frame with no pacing. Every tick is rendered
+// so two builds fed the same demo do exactly the same work.
+bool runTimedemo(SDL_Window* window, SDL_Surface* surface, const Demo& demo) {
+    SDL_Event e;
+    Uint64 start = SDL_GetPerformanceCounter();
+    int frames = 0;
+
+    for (Uint8 buttons : demo.ticks) {
+        if (window) {
+            while (SDL_PollEvent(&e) != 0) {
+                if (e.type == SDL_QUIT || (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE)) {
+                    cout << "Timedemo aborted after " << frames << " frames" << endl;
+                    return false;
+                }
+            }
+        }
 
-            rayX += rayDirX * (closestDist + 0.01);
-            rayY += rayDirY * (closestDist + 0.01);
+        {
+            ProfileScope scope("sim_tick_ms");
+            simulateTick(buttons);
+        }
 
-            currentSector = hitWall->adjoiningSector;
-            if (currentSector < 0 || currentSector >= (int)sectors.size()) break;
+        SDL_FillRect(surface, NULL, SDL_MapRGB(surface->format, 0, 0, 0));
+        {
+            ProfileScope scope("render_ms");
+            renderFrame(surface, captureCamera());
         }
+        if (window) SDL_UpdateWindowSurface(window);
+        frames++;
     }
-	//DEBUGGING REMOVE LATER!
-    renderMinimap(surface);
+
+    double seconds = profilerMs(start, SDL_GetPerformanceCounter()) / 1000.0;
+    cout << "Timedemo: " << frames << " frames in " << seconds << " s, "
+         << (seconds > 0.0 ? frames / seconds : 0.0) << " average FPS" << endl;
+    return true;
 }
 
 int main(int argc, char* argv[]) {
     SDL_Window* window = NULL;
     SDL_Surface* screenSurface = NULL;
 
-    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-        cout << SDL_GetError() << endl;
-        return 1;
+    bool lateLatch = false;
+    bool timedemo = false;
+    bool headless = false;
+    int threads = -1;
+    int spawnCount = 0;
+    string recordFile, playFile;
+    string mapFile = "map.txt";
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--late-latch") lateLatch = true;
+        else if (arg == "--profile") profilerEnabled = true;
+        else if (arg == "--headless") headless = true;
+        else if (arg == "--threads" && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (arg == "--spawn" && i + 1 < argc) spawnCount = atoi(argv[++i]);
+        else if (arg == "--ai-budget" && i + 1 < argc) aiBudgetUs = atof(argv[++i]);
+        else if (arg == "--record" && i + 1 < argc) recordFile = argv[++i];
+        else if (arg == "--play" && i + 1 < argc) playFile = argv[++i];
+        else if (arg == "--timedemo" && i + 1 < argc) {
+            playFile = argv[++i];
+            timedemo = true;
+        }
+        else mapFile = argv[i];
     }
 
-    window = SDL_CreateWindow("Sector & Portal Raycasting with Minimap", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-                              SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
-    if (window == NULL) {
+    Demo demo;
+    bool playing = !playFile.empty();
+    bool recording = !recordFile.empty();
+    if (playing) {
+        if (!demoLoad(playFile, demo)) return 1;
+        if (demo.tickRate != (Uint32)TICK_RATE) {
+            cout << "Demo was recorded at " << demo.tickRate << " Hz, expected " << TICK_RATE << endl;
+            return 1;
+        }
+        recording = false;
+        // Replay the same world the demo was recorded in
+        if (demo.mapFile != mapFile || (int)demo.spawnCount != spawnCount) {
+            cout << "Playing demo on " << demo.mapFile << " with --spawn " << demo.spawnCount << endl;
+        }
+        mapFile = demo.mapFile;
+        spawnCount = (int)demo.spawnCount;
+    }
+    if (playing || recording) aiFixedThinks = AI_DEMO_THINKS;
+    if (headless) {
+        if (!playing) {
+            cout << "--headless needs --play or --timedemo" << endl;
+            return 1;
+        }
+        timedemo = true;
+    }
+
+    if (SDL_Init(headless ? 0 : SDL_INIT_VIDEO) < 0) {
         cout << SDL_GetError() << endl;
-        SDL_Quit();
         return 1;
     }
 
-    screenSurface = SDL_GetWindowSurface(window);
+    jobsInit(threads);
 
-    if (argc >= 2) {
-        loadMapFromFile(argv[1]);
+    if (headless) {
+        screenSurface = SDL_CreateRGBSurfaceWithFormat(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+        if (screenSurface == NULL) {
+            cout << SDL_GetError() << endl;
+            jobsShutdown();
+            SDL_Quit();
+            return 1;
+        }
     } else {
-        loadMapFromFile("map.txt");
+        window = SDL_CreateWindow("Sector & Portal Raycasting with Minimap", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                  SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
+        if (window == NULL) {
+            cout << SDL_GetError() << endl;
+            jobsShutdown();
+            SDL_Quit();
+            return 1;
+        }
+        screenSurface = SDL_GetWindowSurface(window);
+    }
+    // Timedemos run faster than real time, so they stay silent
+    if (!headless && !timedemo) audioInit();
+
+    loadMapFromFile(mapFile);
+    spawnRandomEntities(spawnCount, playing ? demo.spawnSeed : SPAWN_SEED);
+
+    if (playing) {
+        applyCamera(demo.start);
+    } else if (recording) {
+        demo.tickRate = (Uint32)TICK_RATE;
+        demo.mapFile = mapFile;
+        demo.spawnCount = (Uint32)max(spawnCount, 0);
+        demo.spawnSeed = SPAWN_SEED;
+        demo.start = captureCamera();
     }
 
-    bool quit = false;
-    SDL_Event e;
+    bool finishedDemo = false;
+    if (timedemo) {
+        finishedDemo = runTimedemo(window, screenSurface, demo);
+    } else {
+        bool quit = false;
+        SDL_Event e;
+
+        Uint64 freq = SDL_GetPerformanceFrequency();
+        Uint64 frameBudget = (Uint64)(TARGET_FRAME_TIME * freq);
+        Uint64 lastTime = SDL_GetPerformanceCounter();
+        Uint64 nextFrame = lastTime + frameBudget;
+        Uint64 lastReport = lastTime;
+        double accumulator = 0.0;
+        size_t playIndex = 0;
+        Uint8 buttons = 0;
+
+        double predictedWorkMs = 0.0;
+        double latencySumMs = 0.0;
+        int latencyFrames = 0;
+
+        CameraState prevCamera = captureCamera();
+        CameraState currCamera = prevCamera;
+
+        // What the presented frame shows; an identical frame is not redrawn
+        CameraState shownView = currCamera;
+        Uint32 shownWorldVersion = 0, shownEntityVersion = 0;
+        int shownParticles = 0;
+        bool frameShown = false;
+
+        while (!quit) {
+            if (lateLatch) {
+                Uint64 work = (Uint64)((predictedWorkMs + LATE_LATCH_MARGIN_MS) * freq / 1000.0);
+                if (nextFrame > work) waitUntil(nextFrame - work);
+            }
 
-    const double moveSpeed = 0.2;
-    const double rotSpeed = 0.1;
+            Uint64 frameStart = SDL_GetPerformanceCounter();
+            double frameTime = (double)(frameStart - lastTime) / freq;
+            lastTime = frameStart;
+            if (frameTime > MAX_FRAME_TIME) frameTime = MAX_FRAME_TIME;
+            accumulator += frameTime;
 
-    while (!quit) {
-        const Uint8* keystate = SDL_GetKeyboardState(NULL);
+            while (SDL_PollEvent(&e) != 0) {
+                if (e.type == SDL_QUIT || (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE)) {
+                    quit = true;
+                }
+                if (e.type == SDL_WINDOWEVENT) frameShown = false;
+            }
 
-        if (keystate[SDL_SCANCODE_W]) {
-            double newX = posX + dirX * moveSpeed;
-            double newY = posY + dirY * moveSpeed;
-            if (!isMovementBlocked(newX, posY)) posX = newX;
-            if (!isMovementBlocked(posX, newY)) posY = newY;
-        }
-        if (keystate[SDL_SCANCODE_S]) {
-            double newX = posX - dirX * moveSpeed;
-            double newY = posY - dirY * moveSpeed;
-            if (!isMovementBlocked(newX, posY)) posX = newX;
-            if (!isMovementBlocked(posX, newY)) posY = newY;
-        }
-        if (keystate[SDL_SCANCODE_A]) {
-            double oldDirX = dirX;
-            dirX = dirX * cos(rotSpeed) - dirY * sin(rotSpeed);
-            dirY = oldDirX * sin(rotSpeed) + dirY * cos(rotSpeed);
-            double oldPlaneX = planeX;
-            planeX = planeX * cos(rotSpeed) - planeY * sin(rotSpeed);
-            planeY = oldPlaneX * sin(rotSpeed) + planeY * cos(rotSpeed);
-        }
-        if (keystate[SDL_SCANCODE_D]) {
-            double oldDirX = dirX;
-            dirX = dirX * cos(-rotSpeed) - dirY * sin(-rotSpeed);
-            dirY = oldDirX * sin(-rotSpeed) + dirY * cos(-rotSpeed);
-            double oldPlaneX = planeX;
-            planeX = planeX * cos(-rotSpeed) - planeY * sin(-rotSpeed);
-            planeY = oldPlaneX * sin(-rotSpeed) + planeY * cos(-rotSpeed);
-        }
+            Uint64 inputTime = SDL_GetPerformanceCounter();
+            if (!playing) buttons = sampleInput(SDL_GetKeyboardState(NULL));
+            while (accumulator >= TICK_DT) {
+                if (playing) {
+                    if (playIndex == demo.ticks.size()) {
+                        finishedDemo = true;
+                        quit = true;
+                        break;
+                    }
+                    buttons = demo.ticks[playIndex++];
+                }
+                if (recording) demo.ticks.push_back(buttons);
+
+                prevCamera = currCamera;
+                Uint32 passes = linkPasses;
+                {
+                    ProfileScope scope("sim_tick_ms");
+                    simulateTick(buttons);
+                }
+                currCamera = captureCamera();
+                // Don't blend across a teleport
+                if (linkPasses != passes) prevCamera = currCamera;
+                accumulator -= TICK_DT;
+            }
+            if (quit) break;
+
+            CameraState view;
+            if (lateLatch) {
+                // Extrapolate the unfinished tick with the fresh input instead of
+                // showing a blend of two older ticks, then put the player back.
+                // A step through a teleport waits for its tick: the frame picks
+                // its level from posZ, which stays the tick's.
+                double tickZ = posZ;
+                Uint32 passes = linkPasses;
+                updatePlayer(buttons, accumulator);
+                view = linkPasses != passes ? currCamera : captureCamera();
+                applyCamera(currCamera);
+                posZ = tickZ;
+                linkPasses = passes;
+            } else {
+                view = interpolateCamera(prevCamera, currCamera, accumulator / TICK_DT);
+            }
+
+            // Particles move every tick, so a frame that showed any is never reused
+            bool unchanged = frameShown && shownWorldVersion == worldVersion && shownEntityVersion == entityVersion &&
+                             shownParticles == 0 && particles.count() == 0 &&
+                             memcmp(&shownView, &view, sizeof(view)) == 0;
+            if (!unchanged) {
+                SDL_FillRect(screenSurface, NULL, SDL_MapRGB(screenSurface->format, 0, 0, 0));
+                {
+                    ProfileScope scope("render_ms");
+                    renderFrame(screenSurface, view);
+                }
+                SDL_UpdateWindowSurface(window);
+                shownView = view;
+                shownWorldVersion = worldVersion;
+                shownEntityVersion = entityVersion;
+                shownParticles = particles.count();
+                frameShown = true;
+
+                Uint64 presentTime = SDL_GetPerformanceCounter();
+                double latencyMs = profilerMs(inputTime, presentTime);
+                latencySumMs += latencyMs;
+                latencyFrames++;
+                profilerRecord("input_to_present_ms", latencyMs);
+                predictedWorkMs += (latencyMs - predictedWorkMs) * WORK_ESTIMATE_BLEND;
+            }
 
-        SDL_FillRect(screenSurface, NULL, SDL_MapRGB(screenSurface->format, 0, 0, 0));
-        renderFrame(screenSurface);
-        SDL_UpdateWindowSurface(window);
+            if (!lateLatch) waitUntil(nextFrame);
+            nextFrame += frameBudget;
+            Uint64 now = SDL_GetPerformanceCounter();
+            if (nextFrame < now) nextFrame = now + frameBudget;
 
-        while (SDL_PollEvent(&e) != 0) {
-            if (e.type == SDL_QUIT || (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE)) {
-                quit = true;
+            if (profilerEnabled && (double)(now - lastReport) / freq >= PROFILE_REPORT_INTERVAL) {
+                audioPublishStats();
+                profilerReport();
+                lastReport = now;
             }
         }
 
-        SDL_Delay(16);
+        if (latencyFrames > 0) {
+            cout << "Average input-to-present latency: " << latencySumMs / latencyFrames
+                 << " ms over " << latencyFrames << " frames" << (lateLatch ? " (late latch)" : "") << endl;
+        }
+    }
+
+    if (recording) {
+        demo.end = captureCamera();
+        if (demoSave(recordFile, demo)) {
+            cout << "Recorded " << demo.ticks.size() << " ticks to " << recordFile << endl;
+        }
+    }
+    if (playing && finishedDemo) {
+        cout << (demoCamerasMatch(captureCamera(), demo.end) ? "Demo playback matched bit-exactly"
+                                                             : "Demo playback desynced from recording") << endl;
+    }
+    if (profilerEnabled) {
+        audioPublishStats();
+        profilerReport();
     }
 
-    SDL_DestroyWindow(window);
+    audioShutdown();
+    if (headless) SDL_FreeSurface(screenSurface);
+    if (window) SDL_DestroyWindow(window);
+    jobsShutdown();
     SDL_Quit();
     return 0;
 }
-
@@ -0,0 +1,150 @@
+#include <iostream>
+#include <SDL2/SDL.h>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "helpers.h"
+#include "movers.h"
+#include "entities.h"
+#include "polyobj.h"
+#include "triggers.h"
+#include "audio.h"
+
+using namespace std;
+
+vector<Mover> movers;
+vector<int> sectorMover;
+vector<int> changedSectors;
+
+int addMover(int sector, int kind, double low, double high, double speed) {
+    if (sector < 0 || sector >= (int)sectors.size() || kind < MOVER_DOOR || kind > MOVER_CRUSHER) return -1;
+    if ((int)sectorMover.size() != (int)sectors.size()) sectorMover.assign(sectors.size(), -1);
+    if (sectorMover[sector] >= 0) return -1;
+
+    Mover mover = { sector, kind, min(low, high), max(low, high), fabs(speed), 0, 0.0 };
+    Sector& s = sectors[sector];
+    if (kind == MOVER_DOOR) s.ceilingHeight = mover.low;
+    else if (kind == MOVER_LIFT) s.floorHeight = mover.high;
+    else s.ceilingHeight = mover.high;
+
+    sectorMover[sector] = (int)movers.size();
+    movers.push_back(mover);
+    return sectorMover[sector];
+}
+
+void clearMovers() {
+    movers.clear();
+    sectorMover.assign(sectors.size(), -1);
+    changedSectors.clear();
+}
+
+// Middle of the sector's outline, where its mover is heard from
+static void sectorCenter(int sector, double& x, double& y) {
+    x = y = 0.0;
+    int count = 0;
+    for (const Wall& wall : sectors[sector].walls) {
+        if (!wallOnOutline(wall)) continue;
+        x += wall.x1 + wall.x2;
+        y += wall.y1 + wall.y2;
+        count++;
+    }
+    if (count == 0) return;
+    x /= 2.0 * count;
+    y /= 2.0 * count;
+}
+
+bool activateMover(int sector) {
+    if (sector < 0 || sector >= (int)sectorMover.size() || sectorMover[sector] < 0) return false;
+    Mover& m = movers[sectorMover[sector]];
+
+    int direction = m.direction;
+    if (m.kind == MOVER_DOOR) {
+        if (m.direction == 0 && m.waitTimer > 0.0) m.waitTimer = MOVER_WAIT_TIME; // hold it open
+        else m.direction = 1;
+    } else if (m.kind == MOVER_LIFT) {
+        if (m.direction != 0 || m.waitTimer > 0.0) return false;
+        m.direction = -1;
+    } else {
+        if (m.direction != 0) return false;
+        m.direction = -1;
+    }
+    if (m.direction != direction) {
+        double x, y;
+        sectorCenter(sector, x, y);
+        playSound(SOUND_DOOR, sector, x, y, MOVER_SOUND_VOLUME);
+    }
+    return true;
+}
+
+bool useFromPosition(double x, double y, double dirX, double dirY) {
+    int sector = getSectorForFeet(x, y, posZ);
+    if (sector < 0) return false;
+
+    double closestDist = numeric_limits<double>::infinity();
+    const Wall* facing = nullptr;
+    for (const Wall& wall : sectors[sector].walls) {
+        double dist;
+        if (intersectRayWithSegment(x, y, dirX, dirY, wall.x1, wall.y1, wall.x2, wall.y2, dist) && dist < closestDist) {
+            closestDist = dist;
+            facing = &wall;
+        }
+    }
+    if (facing && closestDist <= USE_RANGE) {
+        if (triggerUse(sector, (int)(facing - &sectors[sector].walls[0]))) return true;
+        if (facing->polyobj && activatePolyobj(sector, (int)(facing - &sectors[sector].walls[0]))) return true;
+        if (facing->isPortal && activateMover(facing->adjoiningSector)) return true;
+    }
+    return activateMover(sector);
+}
+
+static bool sectorOccupied(int sector, int& playerSector) {
+    if (playerSector == -2) playerSector = getSectorForFeet(posX, posY, posZ);
+    if (playerSector == sector) return true;
+    const vector<int>& start = sectorBuckets.sectorStart;
+    return sector + 1 < (int)start.size() && start[sector + 1] > start[sector];
+}
+
+void updateMovers(double dt) {
+    changedSectors.clear();
+    int playerSector = -2; // looked up the first time a door needs it
+
+    for (Mover& m : movers) {
+        if (m.direction == 0) {
+            if (m.waitTimer <= 0.0) continue;
+            m.waitTimer -= dt;
+            if (m.waitTimer > 0.0) continue;
+            m.waitTimer = 0.0;
+            m.direction = m.kind == MOVER_DOOR ? -1 : 1;
+        }
+
+        const Sector& sector = sectors[m.sector];
+        bool movesFloor = m.kind == MOVER_LIFT;
+        double current = movesFloor ? sector.floorHeight : sector.ceilingHeight;
+        double target = m.direction > 0 ? m.high : m.low;
+        double next = current + m.direction * m.speed * dt;
+        bool arrived = m.direction > 0 ? next >= target : next <= target;
+        if (arrived) next = target;
+
+        // Doors back off instead of closing on someone
+        if (m.kind == MOVER_DOOR && m.direction < 0 && next - sector.floorHeight < AGENT_HEIGHT &&
+            sectorOccupied(m.sector, playerSector)) {
+            m.direction = 1;
+            continue;
+        }
+
+        if (movesFloor) setSectorPlanes(m.sector, next, sector.ceilingHeight);
+        else setSectorPlanes(m.sector, sector.floorHeight, next);
+        changedSectors.push_back(m.sector);
+
+        if (!arrived) continue;
+        if (m.kind == MOVER_CRUSHER) {
+            m.direction = -m.direction;
+        } else {
+            // Doors park open and lifts park down for a while; both rest at the other end
+            bool awayFromRest = (m.kind == MOVER_DOOR) == (m.direction > 0);
+            m.direction = 0;
+            m.waitTimer = awayFromRest ? MOVER_WAIT_TIME : 0.0;
+        }
+    }
+}
@@ -0,0 +1,45 @@
+// movers.h
+#ifndef MOVERS_H
+#define MOVERS_H
+
+#include <vector>
+
+// Map line: mover sector kind low high speed
+enum MoverKind {
+    MOVER_DOOR = 0,    // ceiling, rests at low (shut), opens to high when used
+    MOVER_LIFT = 1,    // floor, rests at high, lowers to low when used
+    MOVER_CRUSHER = 2, // ceiling, cycles between high and low once started
+};
+
+const double MOVER_WAIT_TIME = 3.0; // seconds doors stay open and lifts stay down
+const double USE_RANGE = 1.5;
+const double MOVER_SOUND_VOLUME = 0.8;
+
+struct Mover {
+    int sector;
+    int kind;
+    double low, high;
+    double speed;     // units per second
+    int direction;    // +1 rising, -1 falling, 0 parked
+    double waitTimer; // seconds left before heading back
+};
+
+extern std::vector<Mover> movers;
+extern std::vector<int> sectorMover;    // mover id per sector, -1 if none
+extern std::vector<int> changedSectors; // sectors moved by the last updateMovers, for caches owned elsewhere
+
+// Puts the sector at the mover's rest position. Call before the derived
+// caches are built. Returns the mover id, or -1 for a bad sector.
+int addMover(int sector, int kind, double low, double high, double speed);
+void clearMovers();
+
+// Starts the sector's mover, playing its sound from the sector's middle
+// if it wasn't already heading that way. False if there is none or it is busy.
+bool activateMover(int sector);
+// The player pressed use: fires the use triggers on the wall they face
+// within USE_RANGE, else activates that sliding wall group or the mover
+// behind that portal, otherwise the mover under them.
+bool useFromPosition(double x, double y, double dirX, double dirY);
+void updateMovers(double dt);
+
+#endif
@@ -0,0 +1,145 @@
+#include <iostream>
+#include <SDL2/SDL.h>
+#include <vector>
+#include <queue>
+#include <cmath>
+#include <unordered_map>
+#include <algorithm>
+#include "helpers.h"
+#include "noise.h"
+#include "path.h"
+#include "entities.h"
+
+using namespace std;
+
+const double NOISE_DISTANCE_FALLOFF = 1.0; // loudness lost per world unit
+const double NOISE_PORTAL_LOSS = 6.0;      // lost through an opening that is nearly shut
+const int MAX_NOISE_SECTORS = 256;
+
+struct NoiseFlood {
+    vector<NoiseReach> reach;
+    vector<int> touched; // reached sectors plus the ones that stopped the flood
+};
+
+static unordered_map<Uint64, NoiseFlood> floodCache;
+static unordered_map<int, vector<Uint64>> floodsBySector;
+
+static Uint64 floodKey(int sector, int band) {
+    return ((Uint64)(Uint32)sector << 32) | (Uint32)band;
+}
+
+// How open the portal is, 0 (shut) to 1 (as tall as the taller side)
+static double portalOpenness(const PortalEdge& edge) {
+    const Sector& from = sectors[edge.fromSector];
+    const Sector& to = sectors[edge.toSector];
+    double opening = min(from.ceilingHeight, to.ceilingHeight) - max(from.floorHeight, to.floorHeight);
+    double tallest = max(from.ceilingHeight - from.floorHeight, to.ceilingHeight - to.floorHeight);
+    if (opening <= 0.0 || tallest <= 0.0) return 0.0;
+    return min(1.0, opening / tallest);
+}
+
+// Best-first flood on remaining loudness. Sound fills the source sector,
+// then pays distance between portal midpoints plus a loss per portal.
+static void floodNoise(int source, double loudness, NoiseFlood& flood) {
+    int count = (int)sectors.size();
+    vector<double> level(count, 0.0);
+    vector<double> atX(count, 0.0), atY(count, 0.0);
+    vector<char> done(count, 0), touched(count, 0);
+    priority_queue<pair<double, int>> open;
+
+    level[source] = loudness;
+    touched[source] = 1;
+    open.push({ loudness, source });
+
+    while (!open.empty() && (int)flood.reach.size() < MAX_NOISE_SECTORS) {
+        pair<double, int> item = open.top();
+        open.pop();
+        int s = item.second;
+        if (done[s] || item.first < level[s]) continue;
+        done[s] = 1;
+        flood.reach.push_back({ s, level[s] });
+
+        for (int e : sectorEdges[s]) {
+            const PortalEdge& edge = portalEdges[e];
+            int n = edge.toSector;
+            touched[n] = 1;
+            if (done[n]) continue;
+
+            double openness = portalOpenness(edge);
+            if (openness <= 0.0) continue;
+
+            double travelled = s == source ? 0.0 : hypot(edge.midX - atX[s], edge.midY - atY[s]);
+            double left = level[s] - travelled * NOISE_DISTANCE_FALLOFF - (1.0 - openness) * NOISE_PORTAL_LOSS;
+            if (left <= level[n]) continue;
+            level[n] = left;
+            atX[n] = edge.midX;
+            atY[n] = edge.midY;
+            open.push({ left, n });
+        }
+    }
+
+    for (int s = 0; s < count; s++) {
+        if (touched[s]) flood.touched.push_back(s);
+    }
+}
+
+const vector<NoiseReach>& propagateNoise(int sourceSector, double loudness) {
+    static const vector<NoiseReach> nothing;
+    if (sourceSector < 0 || sourceSector >= (int)sectors.size() ||
+        sectorEdges.size() != sectors.size() || loudness <= 0.0) return nothing;
+
+    int band = (int)ceil(loudness / NOISE_BAND_SIZE);
+    Uint64 key = floodKey(sourceSector, band);
+    auto it = floodCache.find(key);
+    if (it != floodCache.end()) return it->second.reach;
+
+    NoiseFlood& flood = floodCache[key];
+    floodNoise(sourceSector, band * NOISE_BAND_SIZE, flood);
+    for (int s : flood.touched) floodsBySector[s].push_back(key);
+    return flood.reach;
+}
+
+int emitNoise(int sourceSector, double x, double y, double loudness) {
+    const vector<NoiseReach>& reach = propagateNoise(sourceSector, loudness);
+    const vector<int>& start = sectorBuckets.sectorStart;
+    if (start.size() != sectors.size() + 1) return 0;
+
+    int alerted = 0;
+    for (const NoiseReach& r : reach) {
+        for (int k = start[r.sector]; k < start[r.sector + 1]; k++) {
+            int e = sectorBuckets.sectorEntities[k];
+            if (!(entities.flags[e] & ENTITY_MONSTER)) continue;
+            entities.flags[e] |= ENTITY_ALERTED;
+            entities.alertX[e] = x;
+            entities.alertY[e] = y;
+            alerted++;
+        }
+    }
+    return alerted;
+}
+
+// Drops the flood and unlists it from every sector it touched
+static void evictFlood(Uint64 key) {
+    auto it = floodCache.find(key);
+    if (it == floodCache.end()) return;
+    for (int s : it->second.touched) {
+        auto list = floodsBySector.find(s);
+        if (list == floodsBySector.end()) continue;
+        vector<Uint64>& keys = list->second;
+        keys.erase(remove(keys.begin(), keys.end(), key), keys.end());
+        if (keys.empty()) floodsBySector.erase(list);
+    }
+    floodCache.erase(it);
+}
+
+void noiseInvalidateSector(int sector) {
+    auto it = floodsBySector.find(sector);
+    if (it == floodsBySector.end()) return;
+    vector<Uint64> keys = it->second;
+    for (Uint64 key : keys) evictFlood(key);
+}
+
+void noiseClearCache() {
+    floodCache.clear();
+    floodsBySector.clear();
+}
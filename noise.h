@@ -0,0 +1,28 @@
+// noise.h
+#ifndef NOISE_H
+#define NOISE_H
+
+#include <vector>
+
+// Doom-style noise alerts. A noise floods outward through portals, losing
+// loudness with distance and through partly closed openings, and alerts
+// every listener in the sectors it still reaches.
+const double NOISE_BAND_SIZE = 4.0; // loudness is rounded up to a band for caching
+
+struct NoiseReach {
+    int sector;
+    double level; // loudness left on arrival, > 0
+};
+
+// Cached per (source sector, loudness band) until geometry in one of the
+// sectors the flood touched changes.
+const std::vector<NoiseReach>& propagateNoise(int sourceSector, double loudness);
+
+// Floods from the source and alerts entities in the reached sectors.
+// Returns how many listeners were alerted.
+int emitNoise(int sourceSector, double x, double y, double loudness);
+
+void noiseInvalidateSector(int sector);
+void noiseClearCache();
+
+#endif
@@ -0,0 +1,263 @@
+#include <iostream>
+#include <SDL2/SDL.h>
+#include <vector>
+#include <cmath>
+#include <random>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "helpers.h"
+#include "particles.h"
+#include "render.h"
+#include "jobs.h"
+
+using namespace std;
+
+ParticleStore particles;
+
+const float PARTICLE_BOUNCE = 0.4f;   // fraction of vertical speed kept off a floor or ceiling
+const float PARTICLE_FRICTION = 0.7f; // fraction of horizontal speed kept per bounce
+const int PARTICLE_SECTOR_STRIDE = 8; // each update rechecks the sector of one particle in this many
+const double PARTICLE_WORLD_SIZE = 0.02;
+const int PARTICLE_MAX_PIXELS = 4;
+const double PARTICLE_NEAR_CLIP = 0.05;
+const int PARTICLE_BAND = 32;         // columns per draw job
+
+static const Uint8 PARTICLE_RGB[PARTICLE_COLOR_COUNT][3] = {
+    { 255, 210, 80 },  // spark
+    { 170, 0, 0 },     // blood
+    { 150, 140, 120 }, // dust
+};
+
+static minstd_rand particleRng(1);
+
+static void pushParticle(float x, float y, float z, float vx, float vy, float vz, float life, int sector, Uint8 color) {
+    ParticleStore& p = particles;
+    p.x.push_back(x);
+    p.y.push_back(y);
+    p.z.push_back(z);
+    p.vx.push_back(vx);
+    p.vy.push_back(vy);
+    p.vz.push_back(vz);
+    p.life.push_back(life);
+    p.floorZ.push_back((float)sectors[sector].floorHeight);
+    p.ceilZ.push_back((float)sectors[sector].ceilingHeight);
+    p.checkX.push_back(x);
+    p.checkY.push_back(y);
+    p.sector.push_back(sector);
+    p.color.push_back(color);
+}
+
+void emitParticles(int count, int sector, double x, double y, double z,
+                   double dirX, double dirY, double dirZ, double speed, double spread,
+                   double life, int color) {
+    if (sector < 0 || sector >= (int)sectors.size() || color < 0 || color >= PARTICLE_COLOR_COUNT) return;
+    count = min(count, MAX_PARTICLES - particles.count());
+
+    double length = sqrt(dirX * dirX + dirY * dirY + dirZ * dirZ);
+    if (length > 0.0) {
+        dirX /= length;
+        dirY /= length;
+        dirZ /= length;
+    }
+    z = min(max(z, sectors[sector].floorHeight), sectors[sector].ceilingHeight);
+
+    uniform_real_distribution<double> unit(-1.0, 1.0);
+    for (int i = 0; i < count; i++) {
+        double dx = dirX + unit(particleRng) * spread;
+        double dy = dirY + unit(particleRng) * spread;
+        double dz = dirZ + unit(particleRng) * spread;
+        double dl = sqrt(dx * dx + dy * dy + dz * dz);
+        double v = dl > 0.0 ? speed * (0.75 + 0.25 * unit(particleRng)) / dl : 0.0;
+        double l = life * (0.75 + 0.25 * unit(particleRng));
+        pushParticle((float)x, (float)y, (float)z, (float)(dx * v), (float)(dy * v), (float)(dz * v), (float)l, sector, (Uint8)color);
+    }
+}
+
+void clearParticles() {
+    particles = ParticleStore();
+}
+
+// Swap-and-pop, same as entities
+static void removeParticle(int i) {
+    ParticleStore& p = particles;
+    int last = p.count() - 1;
+    p.x[i] = p.x[last]; p.x.pop_back();
+    p.y[i] = p.y[last]; p.y.pop_back();
+    p.z[i] = p.z[last]; p.z.pop_back();
+    p.vx[i] = p.vx[last]; p.vx.pop_back();
+    p.vy[i] = p.vy[last]; p.vy.pop_back();
+    p.vz[i] = p.vz[last]; p.vz.pop_back();
+    p.life[i] = p.life[last]; p.life.pop_back();
+    p.floorZ[i] = p.floorZ[last]; p.floorZ.pop_back();
+    p.ceilZ[i] = p.ceilZ[last]; p.ceilZ.pop_back();
+    p.checkX[i] = p.checkX[last]; p.checkX.pop_back();
+    p.checkY[i] = p.checkY[last]; p.checkY.pop_back();
+    p.sector[i] = p.sector[last]; p.sector.pop_back();
+    p.color[i] = p.color[last]; p.color.pop_back();
+}
+
+void updateParticles(double dt) {
+    ParticleStore& p = particles;
+    int n = p.count();
+    if (n == 0) return;
+
+    // Sector planes can move, so gather them per particle before the SIMD pass
+    static vector<float> sectorFloor, sectorCeil;
+    sectorFloor.resize(sectors.size());
+    sectorCeil.resize(sectors.size());
+    for (int s = 0; s < (int)sectors.size(); s++) {
+        sectorFloor[s] = (float)sectors[s].floorHeight;
+        sectorCeil[s] = (float)sectors[s].ceilingHeight;
+    }
+    for (int i = 0; i < n; i++) {
+        p.floorZ[i] = sectorFloor[p.sector[i]];
+        p.ceilZ[i] = sectorCeil[p.sector[i]];
+    }
+
+    float fdt = (float)dt;
+    float* x = p.x.data();
+    float* y = p.y.data();
+    float* z = p.z.data();
+    float* vx = p.vx.data();
+    float* vy = p.vy.data();
+    float* vz = p.vz.data();
+    float* life = p.life.data();
+    const float* floorZ = p.floorZ.data();
+    const float* ceilZ = p.ceilZ.data();
+
+    int i = 0;
+#ifdef __SSE2__
+    const __m128 dt4 = _mm_set1_ps(fdt);
+    const __m128 fall = _mm_set1_ps(PARTICLE_GRAVITY * fdt);
+    const __m128 bounce = _mm_set1_ps(-PARTICLE_BOUNCE);
+    const __m128 friction = _mm_set1_ps(PARTICLE_FRICTION);
+    for (; i + 3 < n; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+        __m128 qx = _mm_loadu_ps(vx + i), qy = _mm_loadu_ps(vy + i);
+        __m128 qz = _mm_sub_ps(_mm_loadu_ps(vz + i), fall);
+        px = _mm_add_ps(px, _mm_mul_ps(qx, dt4));
+        py = _mm_add_ps(py, _mm_mul_ps(qy, dt4));
+        pz = _mm_add_ps(pz, _mm_mul_ps(qz, dt4));
+
+        __m128 floor4 = _mm_loadu_ps(floorZ + i), ceil4 = _mm_loadu_ps(ceilZ + i);
+        __m128 below = _mm_cmplt_ps(pz, floor4);
+        __m128 above = _mm_cmpgt_ps(pz, ceil4);
+        __m128 hit = _mm_or_ps(below, above);
+        pz = _mm_or_ps(_mm_and_ps(below, floor4), _mm_andnot_ps(below, pz));
+        pz = _mm_or_ps(_mm_and_ps(above, ceil4), _mm_andnot_ps(above, pz));
+        qz = _mm_or_ps(_mm_and_ps(hit, _mm_mul_ps(qz, bounce)), _mm_andnot_ps(hit, qz));
+        qx = _mm_or_ps(_mm_and_ps(hit, _mm_mul_ps(qx, friction)), _mm_andnot_ps(hit, qx));
+        qy = _mm_or_ps(_mm_and_ps(hit, _mm_mul_ps(qy, friction)), _mm_andnot_ps(hit, qy));
+
+        _mm_storeu_ps(x + i, px);
+        _mm_storeu_ps(y + i, py);
+        _mm_storeu_ps(z + i, pz);
+        _mm_storeu_ps(vx + i, qx);
+        _mm_storeu_ps(vy + i, qy);
+        _mm_storeu_ps(vz + i, qz);
+        _mm_storeu_ps(life + i, _mm_sub_ps(_mm_loadu_ps(life + i), dt4));
+    }
+#endif
+    for (; i < n; i++) {
+        vz[i] -= PARTICLE_GRAVITY * fdt;
+        x[i] += vx[i] * fdt;
+        y[i] += vy[i] * fdt;
+        z[i] += vz[i] * fdt;
+        if (z[i] < floorZ[i] || z[i] > ceilZ[i]) {
+            z[i] = z[i] < floorZ[i] ? floorZ[i] : ceilZ[i];
+            vz[i] *= -PARTICLE_BOUNCE;
+            vx[i] *= PARTICLE_FRICTION;
+            vy[i] *= PARTICLE_FRICTION;
+        }
+        life[i] -= fdt;
+    }
+
+    // Follow portals for a rotating slice of particles; one that went through
+    // solid wall at its height or off the map since its last check dies
+    static unsigned pass = 0;
+    pass++;
+    for (int k = pass % PARTICLE_SECTOR_STRIDE; k < n; k += PARTICLE_SECTOR_STRIDE) {
+        int s = updateSectorForMove(p.sector[k], p.checkX[k], p.checkY[k], x[k], y[k], z[k]);
+        if (s < 0) {
+            life[k] = 0.0f;
+            continue;
+        }
+        p.sector[k] = s;
+        p.checkX[k] = x[k];
+        p.checkY[k] = y[k];
+    }
+
+    for (int k = 0; k < p.count();) {
+        if (p.life[k] <= 0.0f) removeParticle(k);
+        else k++;
+    }
+}
+
+struct ParticleDot {
+    float depth;
+    int x0, x1, y0, y1;
+    Uint8 color;
+};
+
+void renderParticles(SDL_Surface* surface, const CameraState& cam, double playerHeight) {
+    const ParticleStore& p = particles;
+    int n = p.count();
+    if (n == 0) return;
+
+    static vector<ParticleDot> dots;
+    static vector<int> bandStart, bandDots;
+    dots.clear();
+
+    double invDet = 1.0 / (cam.planeX * cam.dirY - cam.dirX * cam.planeY);
+    for (int i = 0; i < n; i++) {
+        double relX = p.x[i] - cam.posX;
+        double relY = p.y[i] - cam.posY;
+        double transformY = invDet * (-cam.planeY * relX + cam.planeX * relY);
+        if (transformY < PARTICLE_NEAR_CLIP) continue;
+        double transformX = invDet * (cam.dirY * relX - cam.dirX * relY);
+
+        int size = min(PARTICLE_MAX_PIXELS, max(1, (int)(PARTICLE_WORLD_SIZE * SCREEN_HEIGHT / transformY)));
+        int sx = (int)((SCREEN_WIDTH / 2.0) * (1.0 + transformX / transformY)) - size / 2;
+        int sy = (int)((SCREEN_HEIGHT / 2.0) - (p.z[i] - playerHeight) * SCREEN_HEIGHT / transformY) - size / 2;
+        if (sx + size <= 0 || sx >= SCREEN_WIDTH || sy + size <= 0 || sy >= SCREEN_HEIGHT) continue;
+
+        dots.push_back({ (float)transformY, max(0, sx), min(SCREEN_WIDTH, sx + size),
+                         max(0, sy), min(SCREEN_HEIGHT, sy + size), p.color[i] });
+    }
+    if (dots.empty()) return;
+
+    // Counting sort into column bands; a dot straddling a band edge goes in both
+    int bands = (SCREEN_WIDTH + PARTICLE_BAND - 1) / PARTICLE_BAND;
+    bandStart.assign(bands + 1, 0);
+    for (const ParticleDot& dot : dots) {
+        int b0 = dot.x0 / PARTICLE_BAND, b1 = (dot.x1 - 1) / PARTICLE_BAND;
+        for (int b = b0; b <= b1; b++) bandStart[b + 1]++;
+    }
+    for (int b = 0; b < bands; b++) bandStart[b + 1] += bandStart[b];
+    bandDots.resize(bandStart[bands]);
+    vector<int> fill(bandStart.begin(), bandStart.end() - 1);
+    for (int d = 0; d < (int)dots.size(); d++) {
+        int b0 = dots[d].x0 / PARTICLE_BAND, b1 = (dots[d].x1 - 1) / PARTICLE_BAND;
+        for (int b = b0; b <= b1; b++) bandDots[fill[b]++] = d;
+    }
+
+    Uint32 colors[PARTICLE_COLOR_COUNT];
+    for (int c = 0; c < PARTICLE_COLOR_COUNT; c++) {
+        colors[c] = SDL_MapRGB(surface->format, PARTICLE_RGB[c][0], PARTICLE_RGB[c][1], PARTICLE_RGB[c][2]);
+    }
+
+    parallelFor(0, bands, 1, [&](int first, int last) {
+        for (int b = first; b < last; b++) {
+            int bandX0 = b * PARTICLE_BAND, bandX1 = min(SCREEN_WIDTH, bandX0 + PARTICLE_BAND);
+            for (int k = bandStart[b]; k < bandStart[b + 1]; k++) {
+                const ParticleDot& dot = dots[bandDots[k]];
+                Uint32 color = colors[dot.color];
+                for (int x = max(dot.x0, bandX0); x < min(dot.x1, bandX1); x++) {
+                    drawOccludedLine(surface, x, dot.y0, dot.y1, dot.depth, color);
+                }
+            }
+        }
+    });
+}
@@ -0,0 +1,46 @@
+// particles.h
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+#include "helpers.h"
+
+const int MAX_PARTICLES = 1 << 17;
+const float PARTICLE_GRAVITY = 9.8f;
+
+enum {
+    PARTICLE_SPARK = 0,
+    PARTICLE_BLOOD = 1,
+    PARTICLE_DUST = 2,
+    PARTICLE_COLOR_COUNT
+};
+
+// Float component arrays so the update runs four particles per SSE op.
+// floorZ/ceilZ are the planes of the cached sector, gathered each update
+// so moving sectors are picked up without a lookup per lane.
+struct ParticleStore {
+    std::vector<float> x, y, z;
+    std::vector<float> vx, vy, vz;
+    std::vector<float> life; // seconds left
+    std::vector<float> floorZ, ceilZ;
+    std::vector<float> checkX, checkY; // where the cached sector was last confirmed
+    std::vector<int> sector;
+    std::vector<Uint8> color;
+
+    int count() const { return (int)x.size(); }
+};
+
+extern ParticleStore particles;
+
+// A burst spread around (dirX, dirY, dirZ); directions need not be normalized.
+void emitParticles(int count, int sector, double x, double y, double z,
+                   double dirX, double dirY, double dirZ, double speed, double spread,
+                   double life, int color);
+void updateParticles(double dt);
+void clearParticles();
+
+// Screen-space squares, clipped against the wall depth buffer.
+void renderParticles(SDL_Surface* surface, const CameraState& cam, double playerHeight);
+
+#endif
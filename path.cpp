@@ -0,0 +1,431 @@
+#include <iostream>
+#include <SDL2/SDL.h>
+#include <vector>
+#include <queue>
+#include <cmath>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include "helpers.h"
+#include "path.h"
+#include "jobs.h"
+
+using namespace std;
+
+vector<PortalEdge> portalEdges;
+vector<vector<int>> sectorEdges;
+vector<int> reverseEdges;
+
+const int PATH_GRAIN = 8;
+
+struct CachedCorridor {
+    bool found;
+    vector<int> edges;
+};
+
+static unordered_map<Uint64, CachedCorridor> corridorCache;
+static unordered_map<int, vector<Uint64>> corridorsBySector;
+static vector<Uint64> failedCorridors;
+static shared_mutex cacheMutex;
+
+static Uint64 corridorKey(int startSector, int goalSector) {
+    return ((Uint64)(Uint32)startSector << 32) | (Uint32)goalSector;
+}
+
+void buildPortalGraph() {
+    portalEdges.clear();
+    sectorEdges.assign(sectors.size(), vector<int>());
+    pathClearCache();
+
+    for (int s = 0; s < (int)sectors.size(); s++) {
+        const Sector& sector = sectors[s];
+        if (sector.walls.empty()) continue;
+
+        double centerX = 0.0, centerY = 0.0;
+        int outlineWalls = 0;
+        for (const Wall& wall : sector.walls) {
+            if (!wallOnOutline(wall)) continue;
+            centerX += wall.x1 + wall.x2;
+            centerY += wall.y1 + wall.y2;
+            outlineWalls++;
+        }
+        if (outlineWalls == 0) continue;
+        centerX /= 2.0 * outlineWalls;
+        centerY /= 2.0 * outlineWalls;
+
+        for (const Wall& wall : sector.walls) {
+            int n = wall.adjoiningSector;
+            if (!wall.isPortal || n < 0 || n >= (int)sectors.size()) continue;
+
+            PortalEdge edge;
+            edge.fromSector = s;
+            edge.toSector = n;
+            edge.midX = (wall.x1 + wall.x2) * 0.5;
+            edge.midY = (wall.y1 + wall.y2) * 0.5;
+
+            // Walls aren't consistently wound, so orient by which side the
+            // sector center is on: forward points out of this sector.
+            double forwardX = edge.midX - centerX, forwardY = edge.midY - centerY;
+            double leftSide = (wall.x1 - edge.midX) * -forwardY + (wall.y1 - edge.midY) * forwardX;
+            if (leftSide >= 0.0) {
+                edge.leftX = wall.x1; edge.leftY = wall.y1;
+                edge.rightX = wall.x2; edge.rightY = wall.y2;
+            } else {
+                edge.leftX = wall.x2; edge.leftY = wall.y2;
+                edge.rightX = wall.x1; edge.rightY = wall.y1;
+            }
+
+            sectorEdges[s].push_back((int)portalEdges.size());
+            portalEdges.push_back(edge);
+        }
+    }
+
+    reverseEdges.assign(portalEdges.size(), -1);
+    for (int e = 0; e < (int)portalEdges.size(); e++) {
+        const PortalEdge& edge = portalEdges[e];
+        for (int r : sectorEdges[edge.toSector]) {
+            const PortalEdge& back = portalEdges[r];
+            if (back.toSector == edge.fromSector &&
+                fabs(back.midX - edge.midX) < 1e-6 && fabs(back.midY - edge.midY) < 1e-6) {
+                reverseEdges[e] = r;
+                break;
+            }
+        }
+    }
+}
+
+bool portalEdgePassable(const PortalEdge& edge) {
+    const Sector& from = sectors[edge.fromSector];
+    const Sector& to = sectors[edge.toSector];
+    if (to.floorHeight - from.floorHeight > MAX_STEP_HEIGHT) return false;
+    return min(from.ceilingHeight, to.ceilingHeight) - max(from.floorHeight, to.floorHeight) >= AGENT_HEIGHT;
+}
+
+// A* over sectors. A sector's position is where we entered it: the start
+// point, or the midpoint of the portal we came through.
+static bool searchCorridor(const PathRequest& request, vector<int>& edges) {
+    int count = (int)sectors.size();
+    vector<double> cost(count, 1e30);
+    vector<int> cameBy(count, -1);
+    vector<double> atX(count), atY(count);
+    vector<char> closed(count, 0);
+
+    typedef pair<double, int> QueueItem;
+    priority_queue<QueueItem, vector<QueueItem>, greater<QueueItem>> open;
+
+    int start = request.startSector;
+    cost[start] = 0.0;
+    atX[start] = request.startX;
+    atY[start] = request.startY;
+    open.push({ hypot(request.goalX - request.startX, request.goalY - request.startY), start });
+
+    while (!open.empty()) {
+        int s = open.top().second;
+        open.pop();
+        if (closed[s]) continue;
+        closed[s] = 1;
+
+        if (s == request.goalSector) {
+            edges.clear();
+            for (int at = s; cameBy[at] >= 0; at = portalEdges[cameBy[at]].fromSector) edges.push_back(cameBy[at]);
+            reverse(edges.begin(), edges.end());
+            return true;
+        }
+
+        for (int e : sectorEdges[s]) {
+            const PortalEdge& edge = portalEdges[e];
+            int n = edge.toSector;
+            if (closed[n] || !portalEdgePassable(edge)) continue;
+
+            double g = cost[s] + hypot(edge.midX - atX[s], edge.midY - atY[s]);
+            if (g >= cost[n]) continue;
+            cost[n] = g;
+            cameBy[n] = e;
+            atX[n] = edge.midX;
+            atY[n] = edge.midY;
+            open.push({ g + hypot(request.goalX - edge.midX, request.goalY - edge.midY), n });
+        }
+    }
+    return false;
+}
+
+static double triangleArea2(double ax, double ay, double bx, double by, double cx, double cy) {
+    return (bx - ax) * (cy - ay) - (cx - ax) * (by - ay);
+}
+
+// Simple stupid funnel: pull a string from start to goal through the
+// corridor's portal segments, adding a waypoint at every corner it wraps.
+static void funnelPath(const PathRequest& request, const vector<int>& edges, vector<PathPoint>& points) {
+    struct Gate {
+        double lx, ly, rx, ry;
+    };
+    vector<Gate> gates;
+    for (int e : edges) {
+        const PortalEdge& edge = portalEdges[e];
+        gates.push_back({ edge.leftX, edge.leftY, edge.rightX, edge.rightY });
+    }
+    gates.push_back({ request.goalX, request.goalY, request.goalX, request.goalY });
+
+    points.clear();
+    points.push_back({ request.startX, request.startY });
+
+    double apexX = request.startX, apexY = request.startY;
+    double leftX = apexX, leftY = apexY, rightX = apexX, rightY = apexY;
+    int leftIndex = -1, rightIndex = -1;
+
+    for (int i = 0; i < (int)gates.size(); i++) {
+        const Gate& gate = gates[i];
+
+        // Tighten the right side; if it crosses the left, the left corner is a waypoint
+        if (triangleArea2(apexX, apexY, rightX, rightY, gate.rx, gate.ry) >= 0.0) {
+            bool apexIsRight = apexX == rightX && apexY == rightY;
+            if (apexIsRight || triangleArea2(apexX, apexY, leftX, leftY, gate.rx, gate.ry) < 0.0) {
+                rightX = gate.rx; rightY = gate.ry;
+                rightIndex = i;
+            } else {
+                points.push_back({ leftX, leftY });
+                apexX = leftX; apexY = leftY;
+                rightX = leftX; rightY = leftY;
+                i = leftIndex;
+                rightIndex = leftIndex;
+                continue;
+            }
+        }
+
+        // Same for the left side
+        if (triangleArea2(apexX, apexY, leftX, leftY, gate.lx, gate.ly) <= 0.0) {
+            bool apexIsLeft = apexX == leftX && apexY == leftY;
+            if (apexIsLeft || triangleArea2(apexX, apexY, rightX, rightY, gate.lx, gate.ly) > 0.0) {
+                leftX = gate.lx; leftY = gate.ly;
+                leftIndex = i;
+            } else {
+                points.push_back({ rightX, rightY });
+                apexX = rightX; apexY = rightY;
+                leftX = rightX; leftY = rightY;
+                i = rightIndex;
+                leftIndex = rightIndex;
+                continue;
+            }
+        }
+    }
+
+    PathPoint goal = { request.goalX, request.goalY };
+    if (points.back().x != goal.x || points.back().y != goal.y) points.push_back(goal);
+}
+
+static bool validRequest(const PathRequest& request) {
+    int count = (int)sectors.size();
+    return request.startSector >= 0 && request.startSector < count &&
+           request.goalSector >= 0 && request.goalSector < count &&
+           (int)sectorEdges.size() == count;
+}
+
+bool findPath(const PathRequest& request, Path& out) {
+    out.found = false;
+    out.sectors.clear();
+    out.points.clear();
+    if (!validRequest(request)) return false;
+
+    Uint64 key = corridorKey(request.startSector, request.goalSector);
+    vector<int> edges;
+    bool cached = false;
+    {
+        shared_lock<shared_mutex> lock(cacheMutex);
+        auto it = corridorCache.find(key);
+        if (it != corridorCache.end()) {
+            if (!it->second.found) return false;
+            edges = it->second.edges;
+            cached = true;
+        }
+    }
+
+    if (!cached) {
+        bool found = searchCorridor(request, edges);
+        unique_lock<shared_mutex> lock(cacheMutex);
+        if (corridorCache.emplace(key, CachedCorridor{ found, edges }).second) {
+            if (found) {
+                corridorsBySector[request.startSector].push_back(key);
+                for (int e : edges) corridorsBySector[portalEdges[e].toSector].push_back(key);
+            } else {
+                failedCorridors.push_back(key);
+            }
+        }
+        if (!found) return false;
+    }
+
+    out.found = true;
+    out.sectors.push_back(request.startSector);
+    for (int e : edges) out.sectors.push_back(portalEdges[e].toSector);
+    funnelPath(request, edges, out.points);
+    return true;
+}
+
+void findPaths(const PathRequest* requests, int count, Path* out) {
+    // A corridor is cached from whichever request searched it, so each
+    // missing one is searched for the first request needing it. That keeps
+    // the results the same as calling findPath on the requests in order.
+    vector<int> searchers;
+    vector<char> done(max(count, 0), 0);
+    {
+        shared_lock<shared_mutex> lock(cacheMutex);
+        unordered_set<Uint64> claimed;
+        for (int i = 0; i < count; i++) {
+            if (!validRequest(requests[i])) continue;
+            Uint64 key = corridorKey(requests[i].startSector, requests[i].goalSector);
+            if (corridorCache.find(key) == corridorCache.end() && claimed.insert(key).second) {
+                searchers.push_back(i);
+                done[i] = 1;
+            }
+        }
+    }
+
+    parallelFor(0, (int)searchers.size(), PATH_GRAIN, [&](int first, int last) {
+        for (int k = first; k < last; k++) findPath(requests[searchers[k]], out[searchers[k]]);
+    });
+    parallelFor(0, count, PATH_GRAIN, [&](int first, int last) {
+        for (int i = first; i < last; i++) {
+            if (!done[i]) findPath(requests[i], out[i]);
+        }
+    });
+}
+
+// Caller holds cacheMutex exclusively
+static void evictCorridor(Uint64 key) {
+    auto it = corridorCache.find(key);
+    if (it == corridorCache.end()) return;
+    if (it->second.found) {
+        int startSector = (int)(key >> 32);
+        auto unlist = [key](int sector) {
+            auto list = corridorsBySector.find(sector);
+            if (list == corridorsBySector.end()) return;
+            vector<Uint64>& keys = list->second;
+            keys.erase(remove(keys.begin(), keys.end(), key), keys.end());
+            if (keys.empty()) corridorsBySector.erase(list);
+        };
+        unlist(startSector);
+        for (int e : it->second.edges) unlist(portalEdges[e].toSector);
+    }
+    corridorCache.erase(it);
+}
+
+void pathInvalidateSector(int sector) {
+    unique_lock<shared_mutex> lock(cacheMutex);
+    auto it = corridorsBySector.find(sector);
+    if (it != corridorsBySector.end()) {
+        // Evicting unlists each key from every sector it passes through, this one included
+        vector<Uint64> keys = it->second;
+        for (Uint64 key : keys) evictCorridor(key);
+    }
+    for (Uint64 key : failedCorridors) corridorCache.erase(key);
+    failedCorridors.clear();
+}
+
+void pathClearCache() {
+    unique_lock<shared_mutex> lock(cacheMutex);
+    corridorCache.clear();
+    corridorsBySector.clear();
+    failedCorridors.clear();
+}
+
+static void startFlowBuild(FlowField& field, int goalSector) {
+    int count = (int)sectors.size();
+    field.building = true;
+    field.buildGoalSector = goalSector;
+    field.nextExitEdge.assign(count, -1);
+    field.nextDistance.assign(count, 1e30);
+    field.atX.assign(count, 0.0);
+    field.atY.assign(count, 0.0);
+    field.open = decltype(field.open)();
+
+    field.nextDistance[goalSector] = 0.0;
+    field.atX[goalSector] = field.goalX;
+    field.atY[goalSector] = field.goalY;
+    field.open.push({ 0.0, goalSector });
+}
+
+void flowFieldSetGoal(FlowField& field, int goalSector, double goalX, double goalY) {
+    field.goalX = goalX;
+    field.goalY = goalY;
+    if (goalSector < 0 || goalSector >= (int)sectors.size()) return;
+
+    int target = field.building ? field.buildGoalSector : field.goalSector;
+    if (goalSector != target) startFlowBuild(field, goalSector);
+}
+
+void flowFieldUpdate(FlowField& field, int maxSectors) {
+    if (!field.building) return;
+
+    int expanded = 0;
+    while (!field.open.empty() && expanded < maxSectors) {
+        pair<double, int> item = field.open.top();
+        field.open.pop();
+        int s = item.second;
+        if (item.first > field.nextDistance[s]) continue;
+        expanded++;
+
+        // Relax every neighbour that can walk into s
+        for (int e : sectorEdges[s]) {
+            int inbound = reverseEdges[e];
+            if (inbound < 0) continue;
+            const PortalEdge& edge = portalEdges[inbound];
+            if (!portalEdgePassable(edge)) continue;
+
+            int n = edge.fromSector;
+            double d = field.nextDistance[s] + hypot(edge.midX - field.atX[s], edge.midY - field.atY[s]);
+            if (d >= field.nextDistance[n]) continue;
+            field.nextDistance[n] = d;
+            field.nextExitEdge[n] = inbound;
+            field.atX[n] = edge.midX;
+            field.atY[n] = edge.midY;
+            field.open.push({ d, n });
+        }
+    }
+
+    if (field.open.empty()) {
+        field.building = false;
+        field.goalSector = field.buildGoalSector;
+        field.exitEdge.swap(field.nextExitEdge);
+        field.distance.swap(field.nextDistance);
+    }
+}
+
+void flowFieldInvalidateSector(FlowField& field, int sector) {
+    // A sector the field never reached matters too if it borders one it
+    // did, e.g. a door that was shut
+    bool used = false;
+    if (sector >= 0 && sector < (int)field.distance.size() && (int)sectorEdges.size() == (int)field.distance.size()) {
+        used = field.distance[sector] < 1e30;
+        for (int e : sectorEdges[sector]) {
+            if (field.distance[portalEdges[e].toSector] < 1e30) used = true;
+        }
+    }
+    if (!used && !field.building) return;
+
+    // Rebuild toward the same goal; the old field stays readable meanwhile
+    int goal = field.building ? field.buildGoalSector : field.goalSector;
+    if (goal >= 0 && goal < (int)sectors.size()) startFlowBuild(field, goal);
+}
+
+bool flowFieldTarget(const FlowField& field, int sector, double x, double y, double& targetX, double& targetY) {
+    if (sector < 0 || sector >= (int)field.exitEdge.size()) return false;
+    if (sector == field.goalSector) {
+        targetX = field.goalX;
+        targetY = field.goalY;
+        return true;
+    }
+
+    int e = field.exitEdge[sector];
+    if (e < 0) return false;
+
+    // Aim for the nearest point of the portal, kept slightly inside its ends
+    const PortalEdge& edge = portalEdges[e];
+    double dx = edge.rightX - edge.leftX, dy = edge.rightY - edge.leftY;
+    double length2 = dx * dx + dy * dy;
+    double t = length2 > 0.0 ? ((x - edge.leftX) * dx + (y - edge.leftY) * dy) / length2 : 0.5;
+    t = min(max(t, 0.1), 0.9);
+    targetX = edge.leftX + dx * t;
+    targetY = edge.leftY + dy * t;
+    return true;
+}
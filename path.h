@@ -0,0 +1,84 @@
+// path.h
+#ifndef PATH_H
+#define PATH_H
+
+#include <vector>
+#include <queue>
+#include <functional>
+
+// One direction of a portal: leaving fromSector into toSector. Left and
+// right are as seen by someone walking through it.
+struct PortalEdge {
+    int fromSector, toSector;
+    double leftX, leftY, rightX, rightY;
+    double midX, midY;
+};
+
+extern std::vector<PortalEdge> portalEdges;
+extern std::vector<std::vector<int>> sectorEdges; // outgoing edge ids per sector
+extern std::vector<int> reverseEdges;             // same portal walked the other way
+
+struct PathRequest {
+    int startSector;
+    double startX, startY;
+    int goalSector;
+    double goalX, goalY;
+};
+
+struct PathPoint {
+    double x, y;
+};
+
+struct Path {
+    bool found = false;
+    std::vector<int> sectors;       // sector corridor from start to goal
+    std::vector<PathPoint> points;  // funnel-smoothed waypoints, start and goal included
+};
+
+void buildPortalGraph();
+bool portalEdgePassable(const PortalEdge& edge);
+
+// Sector corridors are found with A* and cached per (start, goal) sector
+// pair; the funnel pass then fits the exact endpoints through the cached
+// portals. Safe to call from several jobs at once. findPaths spreads a
+// batch over the job system and gives the same paths as calling findPath
+// on each request in order.
+bool findPath(const PathRequest& request, Path& out);
+void findPaths(const PathRequest* requests, int count, Path* out);
+
+// Drops cached corridors that pass through the sector, plus every cached
+// failure since a change anywhere may have opened a route.
+void pathInvalidateSector(int sector);
+void pathClearCache();
+
+// One Dijkstra pass outward from the goal sector gives every sector the
+// portal edge to leave through, shared by any number of agents. Work is
+// done in slices by flowFieldUpdate; the last completed field stays
+// readable while the next one is built.
+struct FlowField {
+    int goalSector = -1;
+    double goalX = 0.0, goalY = 0.0;
+    std::vector<int> exitEdge;      // published field, -1 at the goal or where unreachable
+    std::vector<double> distance;
+
+    // In-progress build
+    bool building = false;
+    int buildGoalSector = -1;
+    std::vector<int> nextExitEdge;
+    std::vector<double> nextDistance;
+    std::vector<double> atX, atY;
+    std::priority_queue<std::pair<double, int>, std::vector<std::pair<double, int>>,
+                        std::greater<std::pair<double, int>>> open;
+};
+
+// Only a change of goal sector starts a rebuild; moving inside the goal
+// sector just updates the point agents in that sector steer to.
+void flowFieldSetGoal(FlowField& field, int goalSector, double goalX, double goalY);
+void flowFieldUpdate(FlowField& field, int maxSectors);
+void flowFieldInvalidateSector(FlowField& field, int sector); // rebuilds if it or a neighbour was reached
+
+// Where an agent in `sector` at (x, y) should head next. False if the
+// field has no route from there.
+bool flowFieldTarget(const FlowField& field, int sector, double x, double y, double& targetX, double& targetY);
+
+#endif
@@ -0,0 +1,171 @@
+#include <iostream>
+#include <SDL2/SDL.h>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "helpers.h"
+#include "polyobj.h"
+#include "movers.h"
+#include "audio.h"
+#include "collision.h"
+#include "entities.h"
+
+using namespace std;
+
+vector<Polyobj> polyobjs;
+
+int addPolyobj(int sector, int kind, int firstWall, int wallCount, double a, double b, double c) {
+    if (sector < 0 || sector >= (int)sectors.size() || wallCount <= 0) return -1;
+    if (firstWall < 0 || firstWall + wallCount > (int)sectors[sector].walls.size()) return -1;
+
+    Polyobj p;
+    p.sector = sector;
+    p.firstWall = firstWall;
+    p.wallCount = wallCount;
+    p.kind = kind;
+    p.base.assign(sectors[sector].walls.begin() + firstWall, sectors[sector].walls.begin() + firstWall + wallCount);
+    p.pivotX = p.pivotY = 0.0;
+    p.slideX = p.slideY = 0.0;
+    p.travel = 0.0;
+    p.direction = 0;
+    p.waitTimer = 0.0;
+
+    if (kind == POLY_SLIDE) {
+        double length = sqrt(a * a + b * b);
+        if (length <= 0.0) return -1;
+        p.slideX = a;
+        p.slideY = b;
+        p.speed = fabs(c) / length;
+    } else if (kind == POLY_ROTATE) {
+        p.pivotX = a;
+        p.pivotY = b;
+        p.speed = c * M_PI / 180.0;
+    } else {
+        return -1;
+    }
+
+    polyobjs.push_back(p);
+    return (int)polyobjs.size() - 1;
+}
+
+void clearPolyobjs() {
+    polyobjs.clear();
+}
+
+void polyobjSweptBounds(double& minX, double& minY, double& maxX, double& maxY) {
+    for (const Polyobj& p : polyobjs) {
+        for (const Wall& wall : p.base) {
+            double xs[2] = { wall.x1, wall.x2 }, ys[2] = { wall.y1, wall.y2 };
+            for (int k = 0; k < 2; k++) {
+                if (p.kind == POLY_ROTATE) {
+                    double r = sqrt((xs[k] - p.pivotX) * (xs[k] - p.pivotX) + (ys[k] - p.pivotY) * (ys[k] - p.pivotY));
+                    minX = min(minX, p.pivotX - r);
+                    maxX = max(maxX, p.pivotX + r);
+                    minY = min(minY, p.pivotY - r);
+                    maxY = max(maxY, p.pivotY + r);
+                } else {
+                    minX = min(minX, min(xs[k], xs[k] + p.slideX));
+                    maxX = max(maxX, max(xs[k], xs[k] + p.slideX));
+                    minY = min(minY, min(ys[k], ys[k] + p.slideY));
+                    maxY = max(maxY, max(ys[k], ys[k] + p.slideY));
+                }
+            }
+        }
+    }
+}
+
+bool activatePolyobj(int sector, int wallIndex) {
+    for (Polyobj& p : polyobjs) {
+        if (p.sector != sector || wallIndex < p.firstWall || wallIndex >= p.firstWall + p.wallCount) continue;
+        if (p.kind != POLY_SLIDE) return false;
+        if (p.direction == 0 && p.waitTimer > 0.0) {
+            p.waitTimer = MOVER_WAIT_TIME;
+            return true;
+        }
+        if (p.direction != 1) {
+            // Heard from the middle of the group where it is now
+            double x = 0.0, y = 0.0;
+            for (int i = 0; i < p.wallCount; i++) {
+                const Wall& wall = sectors[p.sector].walls[p.firstWall + i];
+                x += wall.x1 + wall.x2;
+                y += wall.y1 + wall.y2;
+            }
+            playSound(SOUND_DOOR, p.sector, x / (2.0 * p.wallCount), y / (2.0 * p.wallCount), MOVER_SOUND_VOLUME);
+        }
+        p.direction = 1;
+        return true;
+    }
+    return false;
+}
+
+static void transformWalls(const Polyobj& p, double travel, vector<Wall>& out) {
+    out = p.base;
+    if (p.kind == POLY_SLIDE) {
+        double ox = p.slideX * travel, oy = p.slideY * travel;
+        for (Wall& wall : out) {
+            wall.x1 += ox; wall.y1 += oy;
+            wall.x2 += ox; wall.y2 += oy;
+        }
+        return;
+    }
+    double c = cos(travel), s = sin(travel);
+    for (Wall& wall : out) {
+        double x1 = wall.x1 - p.pivotX, y1 = wall.y1 - p.pivotY;
+        double x2 = wall.x2 - p.pivotX, y2 = wall.y2 - p.pivotY;
+        wall.x1 = p.pivotX + c * x1 - s * y1;
+        wall.y1 = p.pivotY + s * x1 + c * y1;
+        wall.x2 = p.pivotX + c * x2 - s * y2;
+        wall.y2 = p.pivotY + s * x2 + c * y2;
+    }
+}
+
+static bool wallsHitSomething(const Polyobj& p, const vector<Wall>& walls) {
+    const vector<int>& start = sectorBuckets.sectorStart;
+    bool haveBucket = p.sector + 1 < (int)start.size();
+    for (const Wall& wall : walls) {
+        if (pointToSegmentDistance(posX, posY, wall.x1, wall.y1, wall.x2, wall.y2) < COLLISION_RADIUS) return true;
+        if (!haveBucket) continue;
+        for (int k = start[p.sector]; k < start[p.sector + 1]; k++) {
+            int e = sectorBuckets.sectorEntities[k];
+            if (pointToSegmentDistance(entities.posX[e], entities.posY[e], wall.x1, wall.y1, wall.x2, wall.y2) < entities.radius[e]) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void updatePolyobjs(double dt) {
+    static vector<Wall> moved;
+    for (Polyobj& p : polyobjs) {
+        double travel;
+        if (p.kind == POLY_ROTATE) {
+            travel = fmod(p.travel + p.speed * dt, 2.0 * M_PI);
+        } else {
+            if (p.direction == 0) {
+                if (p.waitTimer <= 0.0) continue;
+                p.waitTimer -= dt;
+                if (p.waitTimer > 0.0) continue;
+                p.waitTimer = 0.0;
+                p.direction = -1;
+            }
+            travel = min(1.0, max(0.0, p.travel + p.direction * p.speed * dt));
+        }
+
+        transformWalls(p, travel, moved);
+        if (wallsHitSomething(p, moved)) continue;
+
+        vector<Wall>& walls = sectors[p.sector].walls;
+        for (int i = 0; i < p.wallCount; i++) {
+            walls[p.firstWall + i] = moved[i];
+            collisionRefitWall(p.sector, p.firstWall + i);
+        }
+        p.travel = travel;
+        sectorVersion[p.sector] = ++worldVersion;
+
+        if (p.kind == POLY_SLIDE && (travel == 0.0 || travel == 1.0)) {
+            p.waitTimer = travel == 1.0 ? MOVER_WAIT_TIME : 0.0;
+            p.direction = 0;
+        }
+    }
+}
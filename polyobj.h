@@ -0,0 +1,45 @@
+// polyobj.h
+#ifndef POLYOBJ_H
+#define POLYOBJ_H
+
+#include <vector>
+#include "helpers.h"
+
+// Groups of solid walls inside a sector that move as one. Map block:
+//   poly sector wallCount slide dx dy speed      slides by (dx, dy) and back when used
+//   poly sector wallCount rotate px py degrees   spins about (px, py), degrees per second
+// followed by wallCount lines of x1 y1 x2 y2.
+enum PolyobjKind {
+    POLY_SLIDE = 0,
+    POLY_ROTATE = 1,
+};
+
+struct Polyobj {
+    int sector;
+    int firstWall, wallCount; // range in sectors[sector].walls
+    int kind;
+    std::vector<Wall> base;   // walls at rest; moved walls are always recomputed from these
+    double pivotX, pivotY;    // rotate
+    double slideX, slideY;    // slide
+    double speed;             // slide: fraction of the slide per second, rotate: radians per second
+    double travel;            // slide: 0 at rest .. 1 open, rotate: current angle
+    int direction;            // slide: +1 opening, -1 closing, 0 parked
+    double waitTimer;
+};
+
+extern std::vector<Polyobj> polyobjs;
+
+// The walls must already be appended to the sector with polyobj set.
+int addPolyobj(int sector, int kind, int firstWall, int wallCount, double a, double b, double c);
+void clearPolyobjs();
+
+// Bounds covering every position the groups can reach, for the collision grid
+void polyobjSweptBounds(double& minX, double& minY, double& maxX, double& maxY);
+
+bool activatePolyobj(int sector, int wallIndex);
+
+// Moves the groups and refits only their walls in the collision grid. A
+// group that would hit the player or an entity holds still for the tick.
+void updatePolyobjs(double dt);
+
+#endif
@@ -0,0 +1,128 @@
+#include <iostream>
+#include <SDL2/SDL.h>
+#include <vector>
+#include <cmath>
+#include "helpers.h"
+#include "portals.h"
+
+using namespace std;
+
+const double LINK_LENGTH_EPSILON = 1e-6;
+
+vector<PortalLink> portalLinks;
+Uint32 linkPasses = 0;
+
+static bool validLinkWall(int sector, int wall) {
+    if (sector < 0 || sector >= (int)sectors.size()) return false;
+    if (wall < 0 || wall >= (int)sectors[sector].walls.size()) return false;
+    const Wall& w = sectors[sector].walls[wall];
+    return !w.isPortal && !w.polyobj && !w.stacked;
+}
+
+// +1 if the outline winds counter-clockwise (inside on the left of every wall), -1 if clockwise
+static double outlineWinding(int sector) {
+    double area = 0.0;
+    for (const Wall& wall : sectors[sector].walls) {
+        if (wallOnOutline(wall)) area += wall.x1 * wall.y2 - wall.x2 * wall.y1;
+    }
+    return area >= 0.0 ? 1.0 : -1.0;
+}
+
+int addTeleportLink(int sector, int wall, int targetSector, int targetWall) {
+    if (!validLinkWall(sector, wall) || !validLinkWall(targetSector, targetWall)) return -1;
+    if (sectors[sector].walls[wall].link >= 0 || (sector == targetSector && wall == targetWall)) return -1;
+    const Wall& a = sectors[sector].walls[wall];
+    const Wall& b = sectors[targetSector].walls[targetWall];
+    double ax = a.x2 - a.x1, ay = a.y2 - a.y1;
+    double bx = b.x2 - b.x1, by = b.y2 - b.y1;
+    double length = hypot(ax, ay);
+    if (length < LINK_LENGTH_EPSILON || fabs(length - hypot(bx, by)) > LINK_LENGTH_EPSILON) return -1;
+
+    // Rotate so the inside of one wall lands on the outside of the other:
+    // with matching windings a's start goes to b's end, else to b's start
+    bool reversed = outlineWinding(sector) == outlineWinding(targetSector);
+    double fromX = reversed ? b.x2 : b.x1, fromY = reversed ? b.y2 : b.y1;
+    if (reversed) {
+        bx = -bx;
+        by = -by;
+    }
+    double c = (ax * bx + ay * by) / (length * length);
+    double s = (ax * by - ay * bx) / (length * length);
+
+    PortalLink link;
+    link.sector = sector;
+    link.wall = wall;
+    link.targetSector = targetSector;
+    link.mirror = false;
+    link.transform = { c, -s, s, c, 0.0, 0.0 };
+    link.transform.tx = fromX - (c * a.x1 - s * a.y1);
+    link.transform.ty = fromY - (s * a.x1 + c * a.y1);
+    portalLinks.push_back(link);
+    sectors[sector].walls[wall].link = (int)portalLinks.size() - 1;
+    return (int)portalLinks.size() - 1;
+}
+
+int addMirror(int sector, int wall) {
+    if (!validLinkWall(sector, wall) || sectors[sector].walls[wall].link >= 0) return -1;
+    const Wall& w = sectors[sector].walls[wall];
+    double length = hypot(w.x2 - w.x1, w.y2 - w.y1);
+    if (length < LINK_LENGTH_EPSILON) return -1;
+
+    // Reflection across the wall line: p - 2 ((p - p1) . n) n
+    double nx = -(w.y2 - w.y1) / length, ny = (w.x2 - w.x1) / length;
+    double d = w.x1 * nx + w.y1 * ny;
+    PortalLink link;
+    link.sector = sector;
+    link.wall = wall;
+    link.targetSector = sector;
+    link.mirror = true;
+    link.transform = { 1.0 - 2.0 * nx * nx, -2.0 * nx * ny, -2.0 * nx * ny, 1.0 - 2.0 * ny * ny, 2.0 * d * nx, 2.0 * d * ny };
+    portalLinks.push_back(link);
+    sectors[sector].walls[wall].link = (int)portalLinks.size() - 1;
+    return (int)portalLinks.size() - 1;
+}
+
+void clearPortalLinks() {
+    for (Sector& sector : sectors) {
+        for (Wall& wall : sector.walls) wall.link = -1;
+    }
+    portalLinks.clear();
+}
+
+void transformPoint(const PortalTransform& t, double& x, double& y) {
+    double nx = t.xx * x + t.xy * y + t.tx;
+    y = t.yx * x + t.yy * y + t.ty;
+    x = nx;
+}
+
+void transformVector(const PortalTransform& t, double& x, double& y) {
+    double nx = t.xx * x + t.xy * y;
+    y = t.yx * x + t.yy * y;
+    x = nx;
+}
+
+bool passPortalLink(double newX, double newY) {
+    if (portalLinks.empty()) return false;
+    int sector = getSectorForFeet(posX, posY, posZ);
+    if (sector < 0) return false;
+
+    for (const Wall& wall : sectors[sector].walls) {
+        if (wall.link < 0) continue;
+        const PortalLink& link = portalLinks[wall.link];
+        if (link.mirror || !segmentsIntersect(posX, posY, newX, newY, wall.x1, wall.y1, wall.x2, wall.y2)) continue;
+
+        double x = newX, y = newY;
+        transformPoint(link.transform, x, y);
+        // Floors can move, so the height step is taken as the player passes
+        double z = posZ + sectors[link.targetSector].floorHeight - sectors[link.sector].floorHeight;
+        if (isMovementBlocked(x, y, COLLISION_RADIUS, z, true)) return true;
+        posX = x;
+        posY = y;
+        posZ = z;
+        transformVector(link.transform, dirX, dirY);
+        transformVector(link.transform, planeX, planeY);
+        linkPasses++;
+        return true;
+    }
+    return false;
+}
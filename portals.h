@@ -0,0 +1,46 @@
+// portals.h
+#ifndef PORTALS_H
+#define PORTALS_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+
+// Rigid 2D map: x' = xx * x + xy * y + tx, y' = yx * x + yy * y + ty
+struct PortalTransform {
+    double xx, xy, yx, yy;
+    double tx, ty;
+};
+
+// A solid wall that shows another place instead of itself. Rays reaching
+// it carry on in the target sector through the transform; a teleport also
+// moves the player through, a mirror stays solid.
+struct PortalLink {
+    int sector, wall;
+    int targetSector;
+    bool mirror;
+    PortalTransform transform; // from the wall's sector into the target's coordinates
+};
+
+extern std::vector<PortalLink> portalLinks;
+extern Uint32 linkPasses; // bumped each time passPortalLink moves the player through
+
+// Map lines:
+//   link sector wall targetSector targetWall   the two walls must be the same length;
+//                                               walking into one comes out of the other
+//   mirror sector wall
+// Both walls are ordinary solid walls in their sectors. Returns the link
+// id, or -1 if a wall doesn't exist, is a portal or the lengths differ.
+int addTeleportLink(int sector, int wall, int targetSector, int targetWall);
+int addMirror(int sector, int wall);
+void clearPortalLinks();
+
+void transformPoint(const PortalTransform& t, double& x, double& y);
+void transformVector(const PortalTransform& t, double& x, double& y);
+
+// If the player's step to (newX, newY) crosses a teleport in their
+// sector, moves them through it (position, view, and feet height by the
+// floor step as it is now) and returns true. The step is used up even if
+// the far side is blocked.
+bool passPortalLink(double newX, double newY);
+
+#endif
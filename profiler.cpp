@@ -0,0 +1,60 @@
+#include <iostream>
+#include <SDL2/SDL.h>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <cstdio>
+#include "profiler.h"
+
+using namespace std;
+
+bool profilerEnabled = false;
+
+struct ProfileStat {
+    string name;
+    int count = 0;
+    double sum = 0.0;
+    double minValue = 0.0;
+    double maxValue = 0.0;
+};
+
+static vector<ProfileStat> stats;
+static mutex statsMutex;
+
+double profilerMs(Uint64 start, Uint64 end) {
+    return (double)(end - start) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+void profilerRecord(const char* name, double value) {
+    lock_guard<mutex> lock(statsMutex);
+    ProfileStat* stat = nullptr;
+    for (ProfileStat& s : stats) {
+        if (s.name == name) {
+            stat = &s;
+            break;
+        }
+    }
+    if (!stat) {
+        stats.push_back(ProfileStat());
+        stat = &stats.back();
+        stat->name = name;
+    }
+
+    if (stat->count == 0 || value < stat->minValue) stat->minValue = value;
+    if (stat->count == 0 || value > stat->maxValue) stat->maxValue = value;
+    stat->sum += value;
+    stat->count++;
+}
+
+void profilerReport() {
+    lock_guard<mutex> lock(statsMutex);
+    for (ProfileStat& s : stats) {
+        if (s.count == 0) continue;
+        char line[160];
+        snprintf(line, sizeof(line), "%-24s n=%-6d avg=%9.3f min=%9.3f max=%9.3f",
+                 s.name.c_str(), s.count, s.sum / s.count, s.minValue, s.maxValue);
+        cout << line << endl;
+        s.count = 0;
+        s.sum = 0.0;
+    }
+}
@@ -0,0 +1,26 @@
+// profiler.h
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <SDL2/SDL.h>
+
+// Lightweight named statistics. Samples are accumulated until the next
+// profilerReport(), which prints count/avg/min/max per stat and resets.
+extern bool profilerEnabled;
+
+double profilerMs(Uint64 start, Uint64 end);
+void profilerRecord(const char* name, double value);
+void profilerReport();
+
+// Records the scope's wall time in milliseconds under `name` while
+// profiling is on.
+struct ProfileScope {
+    const char* name;
+    Uint64 start;
+    ProfileScope(const char* n) : name(n), start(profilerEnabled ? SDL_GetPerformanceCounter() : 0) {}
+    ~ProfileScope() {
+        if (profilerEnabled) profilerRecord(name, profilerMs(start, SDL_GetPerformanceCounter()));
+    }
+};
+
+#endif
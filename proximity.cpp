@@ -0,0 +1,170 @@
+#include <iostream>
+#include <SDL2/SDL.h>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "helpers.h"
+#include "proximity.h"
+#include "collision.h"
+#include "entities.h"
+#include "los.h"
+
+using namespace std;
+
+// Per-thread visit stamps, so dedupe never clears an array per query
+struct VisitStamps {
+    vector<Uint32> sectorStamp, wallStamp;
+    Uint32 current = 0;
+
+    void begin() {
+        if (sectorStamp.size() != sectors.size()) sectorStamp.assign(sectors.size(), 0);
+        size_t wallCount = collisionGrid.sectorWallBase.empty() ? 0 : collisionGrid.sectorWallBase.back();
+        if (wallStamp.size() != wallCount) wallStamp.assign(wallCount, 0);
+        if (++current == 0) {
+            fill(sectorStamp.begin(), sectorStamp.end(), 0);
+            fill(wallStamp.begin(), wallStamp.end(), 0);
+            current = 1;
+        }
+    }
+};
+
+static thread_local VisitStamps stamps;
+
+static bool cellBox(const RadiusQuery& q, double pad, int& cx0, int& cy0, int& cx1, int& cy1) {
+    const CollisionGrid& grid = collisionGrid;
+    if (grid.width == 0) return false;
+    double reach = q.radius + pad;
+    cx0 = max(0, (int)floor((q.x - reach - grid.originX) / GRID_CELL_SIZE));
+    cy0 = max(0, (int)floor((q.y - reach - grid.originY) / GRID_CELL_SIZE));
+    cx1 = min(grid.width - 1, (int)floor((q.x + reach - grid.originX) / GRID_CELL_SIZE));
+    cy1 = min(grid.height - 1, (int)floor((q.y + reach - grid.originY) / GRID_CELL_SIZE));
+    return cx0 <= cx1 && cy0 <= cy1;
+}
+
+// Sectors the query can reach: grid cells without occlusion, otherwise a
+// flood through in-range portals that are open at the query height. The
+// grid box is padded so an entity whose circle reaches the radius is
+// found even when its center's sector doesn't.
+static void gatherSectors(const RadiusQuery& q, vector<int>& out) {
+    out.clear();
+    stamps.begin();
+
+    if (!q.occlusion) {
+        int cx0, cy0, cx1, cy1;
+        if (!cellBox(q, GRID_QUERY_PAD, cx0, cy0, cx1, cy1)) return;
+        for (int cy = cy0; cy <= cy1; cy++) {
+            for (int cx = cx0; cx <= cx1; cx++) {
+                for (int s : collisionGrid.cellSectors[cy * collisionGrid.width + cx]) {
+                    if (stamps.sectorStamp[s] == stamps.current) continue;
+                    stamps.sectorStamp[s] = stamps.current;
+                    out.push_back(s);
+                }
+            }
+        }
+        return;
+    }
+
+    if (q.sector < 0 || q.sector >= (int)sectors.size()) return;
+    stamps.sectorStamp[q.sector] = stamps.current;
+    out.push_back(q.sector);
+    for (size_t i = 0; i < out.size(); i++) {
+        int s = out[i];
+        for (const Wall& wall : sectors[s].walls) {
+            int n = wall.adjoiningSector;
+            if (!wall.isPortal || n < 0 || n >= (int)sectors.size() || stamps.sectorStamp[n] == stamps.current) continue;
+            double openBottom = max(sectors[s].floorHeight, sectors[n].floorHeight);
+            double openTop = min(sectors[s].ceilingHeight, sectors[n].ceilingHeight);
+            if (q.z <= openBottom || q.z >= openTop) continue;
+            if (pointToSegmentDistance(q.x, q.y, wall.x1, wall.y1, wall.x2, wall.y2) > q.radius) continue;
+            stamps.sectorStamp[n] = stamps.current;
+            out.push_back(n);
+        }
+    }
+}
+
+static bool nearWall(const RadiusQuery& q, int sector, int w, WallNear& out) {
+    const Wall& wall = sectors[sector].walls[w];
+    double dx = wall.x2 - wall.x1, dy = wall.y2 - wall.y1;
+    double length2 = dx * dx + dy * dy;
+    double t = length2 > 0.0 ? ((q.x - wall.x1) * dx + (q.y - wall.y1) * dy) / length2 : 0.0;
+    t = min(max(t, 0.0), 1.0);
+    out.sector = sector;
+    out.wall = w;
+    out.closestX = wall.x1 + t * dx;
+    out.closestY = wall.y1 + t * dy;
+    out.dist = sqrt((q.x - out.closestX) * (q.x - out.closestX) + (q.y - out.closestY) * (q.y - out.closestY));
+    return out.dist <= q.radius;
+}
+
+void queryWallsInRadius(const RadiusQuery& q, vector<WallNear>& out) {
+    static thread_local vector<int> reached;
+    out.clear();
+    WallNear near;
+
+    if (q.occlusion) {
+        gatherSectors(q, reached);
+        for (int s : reached) {
+            for (int w = 0; w < (int)sectors[s].walls.size(); w++) {
+                if (nearWall(q, s, w, near)) out.push_back(near);
+            }
+        }
+    } else {
+        // Grid cells list every wall that can matter, found by global id
+        const CollisionGrid& grid = collisionGrid;
+        int cx0, cy0, cx1, cy1;
+        stamps.begin();
+        if (!cellBox(q, 0.0, cx0, cy0, cx1, cy1)) return;
+        for (int cy = cy0; cy <= cy1; cy++) {
+            for (int cx = cx0; cx <= cx1; cx++) {
+                for (int id : grid.cellWalls[cy * grid.width + cx]) {
+                    if (stamps.wallStamp[id] == stamps.current) continue;
+                    stamps.wallStamp[id] = stamps.current;
+                    int s = grid.wallSector[id];
+                    if (nearWall(q, s, id - grid.sectorWallBase[s], near)) out.push_back(near);
+                }
+            }
+        }
+    }
+
+    sort(out.begin(), out.end(), [](const WallNear& a, const WallNear& b) { return a.dist < b.dist; });
+}
+
+static bool entityNearer(const EntityNear& a, const EntityNear& b) {
+    return a.dist < b.dist || (a.dist == b.dist && a.entity < b.entity);
+}
+
+static void collectEntities(const RadiusQuery& q, vector<EntityNear>& out) {
+    static thread_local vector<int> reached;
+    out.clear();
+    gatherSectors(q, reached);
+
+    const vector<int>& start = sectorBuckets.sectorStart;
+    if (start.size() != sectors.size() + 1) return;
+    for (int s : reached) {
+        for (int k = start[s]; k < start[s + 1]; k++) {
+            int e = sectorBuckets.sectorEntities[k];
+            if (!(entities.flags[e] & q.entityMask)) continue;
+            double dx = entities.posX[e] - q.x, dy = entities.posY[e] - q.y;
+            double dist = max(0.0, sqrt(dx * dx + dy * dy) - entities.radius[e]);
+            if (dist > q.radius) continue;
+            if (q.occlusion) {
+                LosQuery los = { q.sector, q.x, q.y, q.z,
+                                 s, entities.posX[e], entities.posY[e], sectors[s].floorHeight + QUERY_TARGET_HEIGHT };
+                if (!hasLineOfSight(los)) continue;
+            }
+            out.push_back({ e, dist });
+        }
+    }
+}
+
+void queryEntitiesInRadius(const RadiusQuery& q, vector<EntityNear>& out) {
+    collectEntities(q, out);
+    sort(out.begin(), out.end(), entityNearer);
+}
+
+void queryNearestEntities(const RadiusQuery& q, int k, vector<EntityNear>& out) {
+    collectEntities(q, out);
+    k = min(max(0, k), (int)out.size());
+    partial_sort(out.begin(), out.begin() + k, out.end(), entityNearer);
+    out.resize(k);
+}
@@ -0,0 +1,40 @@
+// proximity.h
+#ifndef PROXIMITY_H
+#define PROXIMITY_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+
+// Everything within a radius of a point: walls with their closest points
+// for explosions, entities for auto-aim and monsters calling to each
+// other. Without occlusion the candidate sectors and walls come from
+// the collision grid cells the radius covers. With occlusion they come
+// from a flood through portals that are within the radius and open at z,
+// and entities must also be in line of sight of the point.
+struct RadiusQuery {
+    int sector;
+    double x, y, z;
+    double radius;
+    Uint32 entityMask;  // entities with any of these flags are returned
+    bool occlusion;
+};
+
+const double QUERY_TARGET_HEIGHT = 0.5; // sight point above an entity's floor
+
+struct WallNear {
+    int sector, wall;
+    double closestX, closestY;
+    double dist;
+};
+
+struct EntityNear {
+    int entity;
+    double dist; // to the edge of its circle, 0 if the point is inside
+};
+
+// Results are sorted nearest first.
+void queryWallsInRadius(const RadiusQuery& query, std::vector<WallNear>& out);
+void queryEntitiesInRadius(const RadiusQuery& query, std::vector<EntityNear>& out);
+void queryNearestEntities(const RadiusQuery& query, int k, std::vector<EntityNear>& out);
+
+#endif
@@ -0,0 +1,701 @@
+#include <iostream>
+#include <SDL2/SDL.h>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <atomic>
+#include <cstring>
+#include "helpers.h"
+#include "render.h"
+#include "jobs.h"
+#include "entities.h"
+#include "particles.h"
+#include "profiler.h"
+#include "portals.h"
+
+using namespace std;
+
+const int COLUMN_GRAIN = 32;
+const double MONSTER_SPRITE_HEIGHT = 1.2;
+const double PICKUP_SPRITE_HEIGHT = 0.4;
+const double SPRITE_NEAR_CLIP = 0.05;
+const int MAX_PORTAL_DEPTH = 256;    // safety cap only; the hop budget normally ends a column first
+const int PORTAL_FREE_DEPTH = 8;     // portals this close in are always followed
+const double PORTAL_FILL_COLUMNS = 3.0; // past that, portals narrower than this on screen are filled flat
+const int PORTAL_HOPS_PER_COLUMN = 24; // frame budget is SCREEN_WIDTH times this
+const int MAX_COLUMN_VIEWS = 8;      // camera transforms one column may pass through, itself included
+const int LINK_MIN_ROWS = 4;         // linked windows shorter than this are filled flat
+const int MAX_MASKED_SPANS = SCREEN_WIDTH * 16; // mid texture windows per frame
+const int MASK_SIZE = 32;            // grate texels per world unit, power of two
+const int BLEND_LEVELS = 4;          // opacity in quarters; the last level is opaque
+const int FOG_LEVELS = 32;
+const double FOG_START_FRACTION = 0.25; // of the far distance; nearer is unfogged
+const int SKY_WIDTH = 2048;               // panorama columns around the full turn, power of two
+const int SKY_HEIGHT = SCREEN_HEIGHT / 2; // screen rows down to the horizon
+const int MAX_COLUMN_SPANS = 32;  // windows waiting to be filled in one column
+const int MAX_WALL_OPENINGS = 4;  // stacked openings on one wall line
+const double PORTAL_EPSILON = 1e-7; // hits this close behind the entry point are the portal itself
+const int MAX_OCCLUSION_RUNS = 64; // depth runs one column can split into
+
+vector<int> visibleSectors;
+vector<MidTexture> midTextures;
+
+// A column's rows split into runs, top to bottom, each with the distance
+// of the nearest opaque surface drawn in it
+struct OcclusionRun {
+    Sint16 top, bottom;
+    float dist;
+};
+
+struct ColumnOcclusion {
+    int count;
+    OcclusionRun runs[MAX_OCCLUSION_RUNS];
+};
+
+static vector<ColumnOcclusion> columnOcclusion(SCREEN_WIDTH);
+
+// Sky panorama, column-major in the surface's pixel format so a screen
+// column is a straight copy
+static vector<Uint32> skyPanorama;
+static Uint32 skyFormat = 0;
+
+// A mid texture window waiting for the masked pass. Each column links its
+// entries farthest first.
+struct MaskedSpan {
+    int next;
+    int mid;
+    double dist;
+    int top, bottom;
+    int u;           // grate texel column
+    Sint64 v, vStep; // grate texel row at top and per screen row, 16.16 fixed point
+};
+
+// Frame arena for the masked spans: claimed with one atomic add while the
+// columns run, dropped all at once by resetting the count next frame
+static vector<MaskedSpan> maskedArena(MAX_MASKED_SPANS);
+static atomic<int> maskedArenaUsed(0);
+static vector<int> maskedHead(SCREEN_WIDTH, -1);
+
+static Uint8 grateMask[MASK_SIZE][MASK_SIZE]; // 1 where the grate is solid
+static Uint8 blendTable[BLEND_LEVELS - 1][256][256]; // [opacity][source][destination] channel
+static bool maskTablesBuilt = false;
+static vector<Uint32> midShades; // FOG_LEVELS per mid texture, rebuilt each frame
+
+static double fogFar = numeric_limits<double>::infinity();
+static Uint8 fogRGB[3] = { 90, 90, 110 };
+
+// Per-sector frame stamps. Columns mark sectors concurrently, so a stamp
+// compare replaces clearing a visited array every frame.
+static vector<atomic<int>> sectorVisitFrame;
+static int frameNumber = 0;
+
+static void markSectorVisible(int sector) {
+    if (sector >= 0 && sector < (int)sectorVisitFrame.size()) {
+        sectorVisitFrame[sector].store(frameNumber, memory_order_relaxed);
+    }
+}
+
+struct SpriteRef {
+    Uint32 key;  // depth bits, sorts the same as the float
+    int entity;
+    float depth;
+    float screenX;
+};
+
+// LSD radix sort on the 32-bit depth key, 8 bits per pass. Positive IEEE
+// floats order the same as their bit patterns.
+static void radixSortSprites(vector<SpriteRef>& sprites, vector<SpriteRef>& scratch) {
+    scratch.resize(sprites.size());
+    for (int shift = 0; shift < 32; shift += 8) {
+        int counts[257] = { 0 };
+        for (const SpriteRef& sprite : sprites) counts[((sprite.key >> shift) & 0xFF) + 1]++;
+        for (int i = 0; i < 256; i++) counts[i + 1] += counts[i];
+        for (const SpriteRef& sprite : sprites) scratch[counts[(sprite.key >> shift) & 0xFF]++] = sprite;
+        sprites.swap(scratch);
+    }
+}
+
+// A window of rows [top, bottom) in one column still to be filled by
+// looking into a sector, entered at ray distance dist.
+struct ColumnSpan {
+    int sector;
+    double dist;
+    int top, bottom;
+    int depth; // portals passed on the way
+    int view;  // index into the column's views
+};
+
+// The camera as seen from the far side of the teleports and mirrors a
+// ray passed. Transforms are rigid, so ray distances carry over unchanged.
+struct ColumnView {
+    CameraState cam;
+    double rayDirX, rayDirY;
+    double eye;
+    const Uint32* skyColumn;
+};
+
+// The part of a wall line open onto a neighbouring sector
+struct Opening {
+    int sector;
+    double low, high;
+};
+
+enum {
+    SHADE_CEILING,
+    SHADE_FLOOR,
+    SHADE_WALL,
+    SHADE_STEP,
+    SHADE_SHUT,
+    SHADE_MONSTER,
+    SHADE_PICKUP,
+    SHADE_COUNT
+};
+
+// Every color faded toward the fog color in FOG_LEVELS steps, rebuilt each
+// frame; the last level is the fog color itself.
+struct ShadeTables {
+    Uint32 shade[SHADE_COUNT][FOG_LEVELS];
+    Uint32 fog;
+    double fogStart, fogScale;
+
+    bool fogged() const { return fogScale > 0.0; }
+    int level(double dist) const {
+        if (!fogged() || dist <= fogStart) return 0;
+        return (int)min((double)(FOG_LEVELS - 1), (dist - fogStart) * fogScale);
+    }
+    Uint32 color(int kind, double dist) const { return shade[kind][level(dist)]; }
+};
+
+// Portal hops a column may still take and the windows it filled flat
+struct ColumnBudget {
+    int hops;
+    int cutoffs;
+};
+
+static int rowForHeight(double height, double playerHeight, double dist) {
+    double row = SCREEN_HEIGHT / 2.0 - (height - playerHeight) * SCREEN_HEIGHT / dist;
+    return (int)floor(min(max(row, -1.0), SCREEN_HEIGHT + 1.0));
+}
+
+// Screen columns covered by a wall line; a line reaching behind the
+// camera counts as the full width
+static double projectedWidth(const CameraState& cam, const Wall& wall) {
+    double invDet = 1.0 / (cam.planeX * cam.dirY - cam.dirX * cam.planeY);
+    auto screenX = [&](double wx, double wy, double& sx) {
+        double relX = wx - cam.posX;
+        double relY = wy - cam.posY;
+        double transformX = invDet * (cam.dirY * relX - cam.dirX * relY);
+        double transformY = invDet * (-cam.planeY * relX + cam.planeX * relY);
+        if (transformY < SPRITE_NEAR_CLIP) return false;
+        sx = (SCREEN_WIDTH / 2.0) * (1.0 + transformX / transformY);
+        return true;
+    };
+    double a, b;
+    if (!screenX(wall.x1, wall.y1, a) || !screenX(wall.x2, wall.y2, b)) return SCREEN_WIDTH;
+    return fabs(a - b);
+}
+
+static void buildSkyPanorama(const SDL_PixelFormat* format) {
+    const double pi = 3.14159265358979323846;
+    skyPanorama.resize((size_t)SKY_WIDTH * SKY_HEIGHT);
+    for (int col = 0; col < SKY_WIDTH; col++) {
+        // Whole multiples of the angle only, so the seam at 360 degrees matches
+        double a = 2.0 * pi * col / SKY_WIDTH;
+        double hills = 0.12 + 0.05 * sin(2.0 * a + 1.0) + 0.03 * sin(7.0 * a + 0.5) + 0.015 * sin(19.0 * a);
+        for (int row = 0; row < SKY_HEIGHT; row++) {
+            double t = (double)row / (SKY_HEIGHT - 1); // 0 at the top, 1 at the horizon
+            double rgb[3] = { 40 + 130 * t, 70 + 130 * t, 160 + 75 * t };
+            if (1.0 - t < hills) {
+                double shade = 0.8 + 0.2 * (1.0 - t) / hills;
+                rgb[0] = 60 * shade;
+                rgb[1] = 85 * shade;
+                rgb[2] = 75 * shade;
+            } else {
+                double cloud = sin(3.0 * a + 2.1) * sin(5.0 * a + row * 0.05) + 0.5 * sin(11.0 * a + row * 0.02);
+                double amount = min(1.0, max(0.0, cloud - 0.4)) * (1.0 - t);
+                for (double& c : rgb) c += (240 - c) * amount;
+            }
+            skyPanorama[(size_t)col * SKY_HEIGHT + row] = SDL_MapRGB(format, (Uint8)rgb[0], (Uint8)rgb[1], (Uint8)rgb[2]);
+        }
+    }
+    skyFormat = format->format;
+}
+
+// Rows [top, bottom) of a screen column from a panorama column; rows below
+// the horizon repeat its last row
+static void drawSky(SDL_Surface* surface, int x, int top, int bottom, const Uint32* skyColumn) {
+    Uint32* pixels = (Uint32*)surface->pixels;
+    int pitch = surface->pitch / 4;
+    int end = min(bottom, SKY_HEIGHT);
+    for (int row = max(top, 0); row < end; row++) pixels[row * pitch + x] = skyColumn[row];
+    if (bottom > SKY_HEIGHT) drawVerticalLine(surface, x, max(top, SKY_HEIGHT), bottom, skyColumn[SKY_HEIGHT - 1]);
+}
+
+static void buildMaskTables() {
+    // Chain link: two diagonal wires per tile
+    for (int v = 0; v < MASK_SIZE; v++) {
+        for (int u = 0; u < MASK_SIZE; u++) {
+            int a = (u + v) & (MASK_SIZE / 2 - 1), b = (u - v) & (MASK_SIZE / 2 - 1);
+            grateMask[v][u] = a < 2 || b < 2;
+        }
+    }
+    for (int level = 0; level < BLEND_LEVELS - 1; level++) {
+        int opacity = 256 * (level + 1) / BLEND_LEVELS;
+        for (int src = 0; src < 256; src++) {
+            for (int dst = 0; dst < 256; dst++) blendTable[level][src][dst] = (Uint8)((src * opacity + dst * (256 - opacity)) >> 8);
+        }
+    }
+    maskTablesBuilt = true;
+}
+
+static void pushMasked(int x, const MaskedSpan& entry) {
+    int slot = maskedArenaUsed.fetch_add(1, memory_order_relaxed);
+    if (slot >= MAX_MASKED_SPANS) return;
+    maskedArena[slot] = entry;
+    int* link = &maskedHead[x];
+    while (*link >= 0 && maskedArena[*link].dist > entry.dist) link = &maskedArena[*link].next;
+    maskedArena[slot].next = *link;
+    *link = slot;
+}
+
+static void drawMasked(SDL_Surface* surface, int x, const MaskedSpan& entry, const ShadeTables& shades) {
+    const MidTexture& mid = midTextures[entry.mid];
+    int level = (mid.alpha * BLEND_LEVELS + 127) / 255 - 1; // quarters of opacity, minus one
+    if (level < 0) return;
+    Uint32 color = midShades[entry.mid * FOG_LEVELS + shades.level(entry.dist)];
+    const SDL_PixelFormat* f = surface->format;
+    Uint32 srcR = (color >> f->Rshift) & 0xFF, srcG = (color >> f->Gshift) & 0xFF, srcB = (color >> f->Bshift) & 0xFF;
+    Uint32 keep = ~(f->Rmask | f->Gmask | f->Bmask);
+
+    Uint32* pixels = (Uint32*)surface->pixels;
+    int pitch = surface->pitch / 4;
+    Sint64 v = entry.v;
+    for (int row = entry.top; row < entry.bottom; row++, v += entry.vStep) {
+        if (mid.kind == MID_GRATE && !grateMask[(v >> 16) & (MASK_SIZE - 1)][entry.u]) continue;
+        Uint32& pixel = pixels[row * pitch + x];
+        if (level == BLEND_LEVELS - 1) {
+            pixel = color;
+            continue;
+        }
+        const Uint8(*table)[256] = blendTable[level];
+        pixel = (pixel & keep) | ((Uint32)table[srcR][(pixel >> f->Rshift) & 0xFF] << f->Rshift) |
+                ((Uint32)table[srcG][(pixel >> f->Gshift) & 0xFF] << f->Gshift) |
+                ((Uint32)table[srcB][(pixel >> f->Bshift) & 0xFF] << f->Bshift);
+    }
+}
+
+// Draws the column's mid textures farther than depth, farthest first
+static void flushMasked(SDL_Surface* surface, int x, double depth, const ShadeTables& shades) {
+    while (maskedHead[x] >= 0 && maskedArena[maskedHead[x]].dist > depth) {
+        drawMasked(surface, x, maskedArena[maskedHead[x]], shades);
+        maskedHead[x] = maskedArena[maskedHead[x]].next;
+    }
+}
+
+// Gives rows [top, bottom) the distance of the sector now drawn in them.
+// A window always lies inside one run of the sector it was seen from; if
+// the column is out of runs the rows keep the nearer distance, which only
+// hides more.
+static void coverRows(ColumnOcclusion& column, int top, int bottom, double dist) {
+    if (top >= bottom) return;
+    for (int i = 0; i < column.count; i++) {
+        OcclusionRun run = column.runs[i];
+        if (top < run.top || bottom > run.bottom) continue;
+        int pieces = (top > run.top) + 1 + (bottom < run.bottom);
+        if (column.count + pieces - 1 > MAX_OCCLUSION_RUNS) return;
+        memmove(&column.runs[i + pieces], &column.runs[i + 1], (column.count - i - 1) * sizeof(OcclusionRun));
+        int k = i;
+        if (top > run.top) column.runs[k++] = { run.top, (Sint16)top, run.dist };
+        column.runs[k++] = { (Sint16)top, (Sint16)bottom, (float)dist };
+        if (bottom < run.bottom) column.runs[k++] = { (Sint16)bottom, run.bottom, run.dist };
+        column.count += pieces - 1;
+        return;
+    }
+}
+
+void drawOccludedLine(SDL_Surface* surface, int x, int top, int bottom, double depth, Uint32 color) {
+    const ColumnOcclusion& column = columnOcclusion[x];
+    for (int i = 0; i < column.count; i++) {
+        const OcclusionRun& run = column.runs[i];
+        if (run.dist <= depth) continue;
+        int r0 = max(top, (int)run.top), r1 = min(bottom, (int)run.bottom);
+        if (r0 < r1) drawVerticalLine(surface, x, r0, r1, color);
+    }
+}
+
+// A floor or ceiling run of rows; each row is one distance from the camera,
+// so with fog on the run is split where the fog level changes
+static void drawPlane(SDL_Surface* surface, int x, int top, int bottom, double eyeAbove, int kind, const ShadeTables& shades) {
+    if (top >= bottom) return;
+    if (!shades.fogged()) {
+        drawVerticalLine(surface, x, top, bottom, shades.shade[kind][0]);
+        return;
+    }
+    int runStart = top, runLevel = -1;
+    for (int row = top; row < bottom; row++) {
+        double rowOffset = row + 0.5 - SCREEN_HEIGHT / 2.0;
+        double dist = eyeAbove * rowOffset > 0.0 ? eyeAbove * SCREEN_HEIGHT / rowOffset : numeric_limits<double>::infinity();
+        int level = shades.level(dist);
+        if (level == runLevel) continue;
+        if (row > runStart) drawVerticalLine(surface, x, runStart, row, shades.shade[kind][runLevel]);
+        runStart = row;
+        runLevel = level;
+    }
+    drawVerticalLine(surface, x, runStart, bottom, shades.shade[kind][runLevel]);
+}
+
+// Front to back through the sectors the ray passes, each one only filling
+// the rows left open by the portals in front of it. A wall line may hold
+// several openings at different heights onto stacked sectors; each gets
+// its own window and the bands between them are drawn as wall.
+// Past PORTAL_FREE_DEPTH a portal is only followed while it still spans a
+// few columns, and every followed portal spends one hop of the budget;
+// windows that aren't followed are filled flat. Nothing past the fog's
+// far distance is traversed; it is all fog, under the sky if the sector
+// beyond has one. Sky ceilings, and the upper wall between two of them,
+// are copied from the panorama column for the ray's heading. Mid textures
+// in an opening don't stop the ray; they are queued for the masked pass.
+// Each sector seen directly (not through a link) stamps the rows of its
+// window with its wall's distance, for sprites and particles to clip to.
+static void renderColumn(SDL_Surface* surface, int x, const CameraState& cam, int playerSector, double playerHeight,
+                         const ShadeTables& shades, ColumnBudget& budget) {
+    double cameraX = 2.0 * x / SCREEN_WIDTH - 1;
+    maskedHead[x] = -1;
+    ColumnView views[MAX_COLUMN_VIEWS];
+    int viewCount = 0;
+    auto addView = [&](const CameraState& viewCam, double eye) {
+        ColumnView& view = views[viewCount];
+        view.cam = viewCam;
+        view.rayDirX = viewCam.dirX + viewCam.planeX * cameraX;
+        view.rayDirY = viewCam.dirY + viewCam.planeY * cameraX;
+        view.eye = eye;
+        int skyCol = (int)floor(atan2(view.rayDirY, view.rayDirX) / (2.0 * 3.14159265358979323846) * SKY_WIDTH) & (SKY_WIDTH - 1);
+        view.skyColumn = skyPanorama.data() + (size_t)skyCol * SKY_HEIGHT;
+        return viewCount++;
+    };
+    addView(cam, playerHeight);
+    ColumnOcclusion& occlusion = columnOcclusion[x];
+    occlusion.count = 1;
+    occlusion.runs[0] = { 0, (Sint16)SCREEN_HEIGHT, 0.0f };
+
+    const int horizon = SCREEN_HEIGHT / 2;
+
+    // A window not walked into: sky down to the horizon if it looks into an open sector, fog below
+    auto fillFar = [&](const ColumnSpan& span, int sector, int top, int bottom) {
+        int split = sectors[sector].sky ? min(bottom, max(top, horizon)) : top;
+        drawSky(surface, x, top, split, views[span.view].skyColumn);
+        drawVerticalLine(surface, x, split, bottom, shades.fog);
+    };
+
+    ColumnSpan pending[MAX_COLUMN_SPANS];
+    int pendingCount = 0;
+    pending[pendingCount++] = { playerSector, 0.0, 0, SCREEN_HEIGHT, 0, 0 };
+
+    while (pendingCount > 0) {
+        ColumnSpan span = pending[--pendingCount];
+        if (span.top >= span.bottom) continue;
+        if (span.dist >= fogFar) {
+            fillFar(span, span.sector, span.top, span.bottom);
+            continue;
+        }
+        const Sector& sector = sectors[span.sector];
+        const vector<Wall>& walls = sector.walls;
+        const ColumnView& view = views[span.view];
+        if (span.view == 0) markSectorVisible(span.sector);
+
+        // Distances are measured from the camera, so a ray grazing a corner
+        // right after a portal still finds the wall it leaves through
+        double minDist = span.depth > 0 ? span.dist + PORTAL_EPSILON : 0.0;
+        double dist = numeric_limits<double>::infinity();
+        int hit = -1;
+        for (int w = 0; w < (int)walls.size(); w++) {
+            const Wall& wall = walls[w];
+            double wallDist;
+            if (!wall.stacked && intersectRayWithSegment(view.cam.posX, view.cam.posY, view.rayDirX, view.rayDirY, wall.x1, wall.y1, wall.x2, wall.y2, wallDist) &&
+                wallDist > minDist && wallDist < dist) {
+                dist = wallDist;
+                hit = w;
+            }
+        }
+        if (span.view == 0) coverRows(occlusion, span.top, span.bottom, hit < 0 ? fogFar : min(dist, fogFar));
+        if (hit < 0) continue;
+
+        auto rows = [&](double high, double low, int& r0, int& r1) {
+            r0 = max(span.top, rowForHeight(high, view.eye, dist));
+            r1 = min(span.bottom, rowForHeight(low, view.eye, dist));
+        };
+        auto band = [&](double high, double low, int kind) {
+            int r0, r1;
+            rows(high, low, r0, r1);
+            if (r0 >= r1) return;
+            drawVerticalLine(surface, x, r0, r1, shades.color(kind, dist));
+        };
+
+        // Ceiling and floor between the entry point and the wall
+        int ceilingRow = min(span.bottom, rowForHeight(sector.ceilingHeight, view.eye, dist));
+        if (sector.sky) drawSky(surface, x, span.top, ceilingRow, view.skyColumn);
+        else drawPlane(surface, x, span.top, ceilingRow, view.eye - sector.ceilingHeight, SHADE_CEILING, shades);
+        drawPlane(surface, x, max(span.top, rowForHeight(sector.floorHeight, view.eye, dist)), span.bottom,
+                  view.eye - sector.floorHeight, SHADE_FLOOR, shades);
+
+        // Openings on this wall line, the original and its stacked copies, highest first
+        const Wall& wall = walls[hit];
+        bool follow = dist < fogFar && span.depth + 1 < MAX_PORTAL_DEPTH &&
+                      (span.depth + 1 < PORTAL_FREE_DEPTH || projectedWidth(view.cam, wall) >= PORTAL_FILL_COLUMNS);
+
+        // A teleport or mirror: the whole wall is a window into the linked
+        // sector, seen by the camera carried through the transform
+        if (wall.link >= 0) {
+            const PortalLink& link = portalLinks[wall.link];
+            int r0, r1;
+            rows(sector.ceilingHeight, sector.floorHeight, r0, r1);
+            if (r0 >= r1) continue;
+            if (follow && viewCount < MAX_COLUMN_VIEWS && r1 - r0 >= LINK_MIN_ROWS && budget.hops > 0 && pendingCount < MAX_COLUMN_SPANS) {
+                CameraState linked = view.cam;
+                transformPoint(link.transform, linked.posX, linked.posY);
+                transformVector(link.transform, linked.dirX, linked.dirY);
+                transformVector(link.transform, linked.planeX, linked.planeY);
+                budget.hops--;
+                pending[pendingCount++] = { link.targetSector, dist, r0, r1, span.depth + 1, addView(linked, view.eye + sectors[link.targetSector].floorHeight - sector.floorHeight) };
+            } else {
+                fillFar(span, link.targetSector, r0, r1);
+                budget.cutoffs++;
+            }
+            continue;
+        }
+        Opening openings[MAX_WALL_OPENINGS];
+        int openingCount = 0;
+        bool portal = false;
+        double solidHigh = sector.ceilingHeight, solidLow = sector.floorHeight;
+        for (int w = hit; w < (int)walls.size(); w++) {
+            const Wall& line = walls[w];
+            if (w != hit && !(line.stacked && line.x1 == wall.x1 && line.y1 == wall.y1 && line.x2 == wall.x2 && line.y2 == wall.y2)) continue;
+            int n = line.adjoiningSector;
+            if (!line.isPortal || n < 0 || n >= (int)sectors.size()) continue;
+            if (!portal) {
+                // A shut door covers both sides' spans
+                solidHigh = max(solidHigh, sectors[n].ceilingHeight);
+                solidLow = min(solidLow, sectors[n].floorHeight);
+            }
+            portal = true;
+            double low = max(sector.floorHeight, sectors[n].floorHeight);
+            double high = min(sector.ceilingHeight, sectors[n].ceilingHeight);
+            if (high <= low || openingCount == MAX_WALL_OPENINGS) continue;
+            int k = openingCount++;
+            for (; k > 0 && openings[k - 1].high < high; k--) openings[k] = openings[k - 1];
+            openings[k] = { n, low, high };
+        }
+        if (openingCount > 0) {
+            solidHigh = sector.ceilingHeight;
+            solidLow = sector.floorHeight;
+        }
+
+        int solid = !portal ? SHADE_WALL : openingCount == 0 ? SHADE_SHUT : SHADE_STEP;
+        double height = solidHigh;
+        for (int k = 0; k < openingCount; k++) {
+            const Opening& opening = openings[k];
+            if (opening.high < height) {
+                if (k == 0 && sector.sky && sectors[opening.sector].sky) {
+                    int r0, r1;
+                    rows(height, opening.high, r0, r1);
+                    drawSky(surface, x, r0, r1, view.skyColumn);
+                } else {
+                    band(height, opening.high, solid);
+                }
+            }
+            height = min(height, opening.low);
+            int r0, r1;
+            rows(opening.high, opening.low, r0, r1);
+            if (r0 >= r1) continue;
+            if (wall.mid >= 0 && dist < fogFar) {
+                double hitX = view.cam.posX + view.rayDirX * dist - wall.x1;
+                double hitY = view.cam.posY + view.rayDirY * dist - wall.y1;
+                double topHeight = view.eye - (r0 + 0.5 - SCREEN_HEIGHT / 2.0) * dist / SCREEN_HEIGHT;
+                double fixedScale = MASK_SIZE * 65536.0;
+                pushMasked(x, { -1, wall.mid, dist, r0, r1, (int)floor(sqrt(hitX * hitX + hitY * hitY) * MASK_SIZE) & (MASK_SIZE - 1),
+                                (Sint64)floor(topHeight * fixedScale), (Sint64)(-dist / SCREEN_HEIGHT * fixedScale) });
+            }
+            if (follow && budget.hops > 0 && pendingCount < MAX_COLUMN_SPANS) {
+                budget.hops--;
+                pending[pendingCount++] = { opening.sector, dist, r0, r1, span.depth + 1, span.view };
+            } else {
+                fillFar(span, opening.sector, r0, r1);
+                budget.cutoffs++;
+            }
+        }
+        if (height > solidLow) band(height, solidLow, solid);
+    }
+}
+
+// Gathers entities only from sectors the wall pass visited, sorts them far
+// to near and draws them column by column behind the occlusion runs.
+static void renderSprites(SDL_Surface* surface, const CameraState& cam, double playerHeight, const ShadeTables& shades) {
+    static vector<SpriteRef> sprites;
+    static vector<SpriteRef> scratch;
+    sprites.clear();
+
+    double invDet = 1.0 / (cam.planeX * cam.dirY - cam.dirX * cam.planeY);
+    double planeLength = sqrt(cam.planeX * cam.planeX + cam.planeY * cam.planeY);
+    const vector<int>& start = sectorBuckets.sectorStart;
+    if (start.size() == sectors.size() + 1) {
+        for (int s : visibleSectors) {
+            for (int k = start[s]; k < start[s + 1]; k++) {
+                int e = sectorBuckets.sectorEntities[k];
+                double relX = entities.posX[e] - cam.posX;
+                double relY = entities.posY[e] - cam.posY;
+                double transformX = invDet * (cam.dirY * relX - cam.dirX * relY);
+                double transformY = invDet * (-cam.planeY * relX + cam.planeX * relY);
+                if (transformY < SPRITE_NEAR_CLIP) continue;
+
+                float depth = (float)transformY;
+                Uint32 key;
+                memcpy(&key, &depth, sizeof(key));
+                sprites.push_back({ key, e, depth, (float)((SCREEN_WIDTH / 2.0) * (1.0 + transformX / transformY)) });
+            }
+        }
+    }
+    if (sprites.empty() && maskedArenaUsed.load(memory_order_relaxed) == 0) return;
+
+    radixSortSprites(sprites, scratch);
+
+    // Strips of columns draw independently; each walks the sorted list back
+    // to front, putting down the column's mid textures behind each sprite first
+    parallelFor(0, SCREEN_WIDTH, COLUMN_GRAIN, [&](int first, int last) {
+        for (int i = (int)sprites.size() - 1; i >= 0; i--) {
+            const SpriteRef& sprite = sprites[i];
+            int e = sprite.entity;
+            double halfWidth = entities.radius[e] / planeLength * (SCREEN_WIDTH / 2.0) / sprite.depth;
+            int startX = max(first, (int)(sprite.screenX - halfWidth));
+            int endX = min(last, (int)(sprite.screenX + halfWidth));
+            if (startX >= endX) continue;
+
+            bool monster = (entities.flags[e] & ENTITY_MONSTER) != 0;
+            double floorHeight = sectors[entities.sector[e]].floorHeight;
+            double height = monster ? MONSTER_SPRITE_HEIGHT : PICKUP_SPRITE_HEIGHT;
+            int top = (int)((SCREEN_HEIGHT / 2.0) - (floorHeight + height - playerHeight) * SCREEN_HEIGHT / sprite.depth);
+            int bottom = (int)((SCREEN_HEIGHT / 2.0) + (playerHeight - floorHeight) * SCREEN_HEIGHT / sprite.depth);
+            top = max(0, top);
+            bottom = min(SCREEN_HEIGHT, bottom);
+            if (top >= bottom) continue;
+
+            Uint32 color = shades.color(monster ? SHADE_MONSTER : SHADE_PICKUP, sprite.depth);
+            for (int x = startX; x < endX; x++) {
+                flushMasked(surface, x, sprite.depth, shades);
+                drawOccludedLine(surface, x, top, bottom, sprite.depth, color);
+            }
+        }
+        for (int x = first; x < last; x++) flushMasked(surface, x, 0.0, shades);
+    });
+}
+
+void renderFrame(SDL_Surface* surface, const CameraState& cam) {
+    int playerSector = getSectorForFeet(cam.posX, cam.posY, posZ);
+    if (playerSector == -1) return;
+
+    double playerHeight = sectors[playerSector].floorHeight + playerEyeHeightOffset;
+
+    if (sectorVisitFrame.size() != sectors.size()) {
+        vector<atomic<int>>(sectors.size()).swap(sectorVisitFrame);
+        for (atomic<int>& stamp : sectorVisitFrame) stamp = -1;
+    }
+    frameNumber++;
+
+    static const Uint8 baseRGB[SHADE_COUNT][3] = {
+        { 100, 100, 255 }, // ceiling
+        { 100, 255, 100 }, // floor
+        { 255, 105, 180 }, // wall
+        { 0, 105, 180 },   // step
+        { 150, 100, 50 },  // shut door
+        { 200, 40, 40 },   // monster
+        { 240, 220, 60 },  // pickup
+    };
+    if (skyPanorama.empty() || skyFormat != surface->format->format) buildSkyPanorama(surface->format);
+
+    ShadeTables shades;
+    for (int kind = 0; kind < SHADE_COUNT; kind++) {
+        for (int level = 0; level < FOG_LEVELS; level++) {
+            double t = (double)level / (FOG_LEVELS - 1);
+            Uint8 rgb[3];
+            for (int c = 0; c < 3; c++) rgb[c] = (Uint8)lround(baseRGB[kind][c] + (fogRGB[c] - baseRGB[kind][c]) * t);
+            shades.shade[kind][level] = SDL_MapRGB(surface->format, rgb[0], rgb[1], rgb[2]);
+        }
+    }
+    shades.fog = SDL_MapRGB(surface->format, fogRGB[0], fogRGB[1], fogRGB[2]);
+    shades.fogStart = fogFar * FOG_START_FRACTION;
+    shades.fogScale = isinf(fogFar) ? 0.0 : (FOG_LEVELS - 1) / (fogFar - shades.fogStart);
+
+    if (!maskTablesBuilt) buildMaskTables();
+    midShades.resize(midTextures.size() * FOG_LEVELS);
+    for (size_t m = 0; m < midTextures.size(); m++) {
+        const Uint8 rgb[3] = { midTextures[m].r, midTextures[m].g, midTextures[m].b };
+        for (int level = 0; level < FOG_LEVELS; level++) {
+            double t = (double)level / (FOG_LEVELS - 1);
+            Uint8 faded[3];
+            for (int c = 0; c < 3; c++) faded[c] = (Uint8)lround(rgb[c] + (fogRGB[c] - rgb[c]) * t);
+            midShades[m * FOG_LEVELS + level] = SDL_MapRGB(surface->format, faded[0], faded[1], faded[2]);
+        }
+    }
+    maskedArenaUsed.store(0, memory_order_relaxed);
+
+    // Columns are independent, so the job system splits them across cores.
+    // Hops a column leaves unused carry to the next column of its
+    // COLUMN_GRAIN strip, so the result doesn't depend on the thread count.
+    atomic<int> hopsUsed(0), cutoffs(0);
+    parallelFor(0, SCREEN_WIDTH, COLUMN_GRAIN, [&](int first, int last) {
+        ColumnBudget budget = { 0, 0 };
+        int used = 0;
+        for (int x = first; x < last; x++) {
+            if (x % COLUMN_GRAIN == 0) budget.hops = 0;
+            budget.hops += PORTAL_HOPS_PER_COLUMN;
+            int before = budget.hops;
+            renderColumn(surface, x, cam, playerSector, playerHeight, shades, budget);
+            used += before - budget.hops;
+        }
+        hopsUsed += used;
+        cutoffs += budget.cutoffs;
+    });
+    if (profilerEnabled) {
+        profilerRecord("portal_hops", hopsUsed.load());
+        profilerRecord("portal_cutoffs", cutoffs.load());
+    }
+
+    visibleSectors.clear();
+    for (int s = 0; s < (int)sectorVisitFrame.size(); s++) {
+        if (sectorVisitFrame[s].load(memory_order_relaxed) == frameNumber) visibleSectors.push_back(s);
+    }
+    renderSprites(surface, cam, playerHeight, shades);
+    renderParticles(surface, cam, playerHeight);
+
+	//DEBUGGING REMOVE LATER!
+    renderMinimap(surface);
+}
+
+void setFog(double farDistance, Uint8 r, Uint8 g, Uint8 b) {
+    fogFar = farDistance > 0.0 ? farDistance : numeric_limits<double>::infinity();
+    fogRGB[0] = r;
+    fogRGB[1] = g;
+    fogRGB[2] = b;
+}
+
+void clearFog() {
+    setFog(0.0, 90, 90, 110);
+}
+
+int addMidTexture(int sector, int wall, int kind, Uint8 r, Uint8 g, Uint8 b, Uint8 alpha) {
+    if (kind < MID_GRATE || kind > MID_GLASS || sector < 0 || sector >= (int)sectors.size()) return -1;
+    if (wall < 0 || wall >= (int)sectors[sector].walls.size() || !sectors[sector].walls[wall].isPortal) return -1;
+
+    midTextures.push_back({ kind, r, g, b, alpha });
+    int id = (int)midTextures.size() - 1;
+    sectors[sector].walls[wall].mid = id;
+    int back = findBackWall(sector, wall);
+    if (back >= 0) sectors[sectors[sector].walls[wall].adjoiningSector].walls[back].mid = id;
+    return id;
+}
+
+void clearMidTextures() {
+    for (Sector& sector : sectors) {
+        for (Wall& wall : sector.walls) wall.mid = -1;
+    }
+    midTextures.clear();
+}
@@ -0,0 +1,50 @@
+// render.h
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+#include "helpers.h"
+
+const int SCREEN_WIDTH = 1080;
+const int SCREEN_HEIGHT = 720;
+const double playerEyeHeightOffset = 1.0;
+
+// Rows [top, bottom) of column x in color, except where the wall pass drew
+// a surface nearer than depth: walls, steps and lintels in front of it.
+// For sprites and particles, drawn after the walls.
+void drawOccludedLine(SDL_Surface* surface, int x, int top, int bottom, double depth, Uint32 color);
+
+// Sectors the wall pass walked through this frame.
+extern std::vector<int> visibleSectors;
+
+void renderFrame(SDL_Surface* surface, const CameraState& cam);
+
+// Surfaces fade toward the fog color with distance and nothing beyond
+// farDistance is drawn or walked through. A distance <= 0 turns fog off;
+// the color still fills windows the portal budget doesn't follow.
+void setFog(double farDistance, Uint8 r, Uint8 g, Uint8 b);
+void clearFog();
+
+// A grate or pane hung in a portal opening. Rays carry on through it; it
+// is drawn after the walls, far to near together with the sprites. alpha
+// is rounded to quarters, 255 being opaque.
+enum {
+    MID_GRATE = 0,
+    MID_GLASS = 1,
+};
+
+struct MidTexture {
+    int kind;
+    Uint8 r, g, b;
+    Uint8 alpha;
+};
+
+extern std::vector<MidTexture> midTextures;
+
+// Hangs it on the portal and the same portal seen from the other side.
+// Returns the id, or -1 if the wall isn't a portal.
+int addMidTexture(int sector, int wall, int kind, Uint8 r, Uint8 g, Uint8 b, Uint8 alpha);
+void clearMidTextures();
+
+#endif
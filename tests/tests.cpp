@@ -0,0 +1,315 @@
+// Regression checks for the simulation side. Build and run from tests/,
+// see notes.txt; exits non-zero if anything fails.
+#include <iostream>
+#include <SDL2/SDL.h>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include "../helpers.h"
+#include "../path.h"
+#include "../entities.h"
+#include "../proximity.h"
+#include "../los.h"
+#include "../hitscan.h"
+#include "../triggers.h"
+#include "../portals.h"
+
+using namespace std;
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (ok) return;
+    cerr << "FAIL: " << what << endl;
+    failures++;
+}
+
+// door.txt: room 0 | door 1 (shut) | room 2, goal in room 0
+static void testFlowFieldDoorOpens() {
+    loadMapFromFile("door.txt");
+    FlowField field;
+    flowFieldSetGoal(field, 0, 2.0, 2.0);
+    flowFieldUpdate(field, 1000);
+    check(!field.building && field.exitEdge.size() == 3, "flow field builds");
+    check(field.exitEdge[2] == -1, "room behind a shut door has no route");
+
+    setSectorPlanes(1, 0.0, 4.0);
+    flowFieldInvalidateSector(field, 1);
+    flowFieldUpdate(field, 1000);
+    check(field.exitEdge[2] == 3, "opening the door routes the far room through it");
+    check(field.exitEdge[1] == 2, "the door itself routes back to the goal");
+}
+
+static bool found(const vector<EntityNear>& near, int entity) {
+    for (const EntityNear& n : near) {
+        if (n.entity == entity) return true;
+    }
+    return false;
+}
+
+static void testRadiusQueriesThroughDoor() {
+    loadMapFromFile("door.txt");
+    int nearMonster = spawnEntity(3.0, 2.0, 0.2, ENTITY_MONSTER);
+    int farMonster = spawnEntity(7.0, 2.0, 0.2, ENTITY_MONSTER);
+    int pickup = spawnEntity(1.0, 2.0, 0.2, ENTITY_PICKUP);
+    rebuildSectorBuckets();
+
+    vector<EntityNear> near;
+    RadiusQuery q = { 0, 2.0, 2.0, 1.0, 8.0, ENTITY_MONSTER, false };
+    queryEntitiesInRadius(q, near);
+    check(near.size() == 2 && near[0].entity == nearMonster && near[1].entity == farMonster,
+          "radius query finds both monsters nearest first and skips the pickup");
+    check(fabs(near[0].dist - 0.8) < 1e-9, "distance is to the edge of the entity");
+
+    q.occlusion = true;
+    queryEntitiesInRadius(q, near);
+    check(found(near, nearMonster) && !found(near, farMonster), "a shut door hides the far room");
+
+    setSectorPlanes(1, 0.0, 4.0);
+    queryEntitiesInRadius(q, near);
+    check(found(near, farMonster), "an open door lets the query through");
+
+    q.radius = 4.0;
+    queryEntitiesInRadius(q, near);
+    check(!found(near, farMonster), "entities past the radius are left out");
+
+    q.radius = 8.0;
+    q.entityMask = ENTITY_MONSTER | ENTITY_PICKUP;
+    queryNearestEntities(q, 2, near);
+    check(near.size() == 2 && near[0].entity == nearMonster && near[1].entity == pickup,
+          "k nearest keeps the k closest in order");
+}
+
+// Every wall of every sector within the radius, by (sector, wall)
+static vector<WallNear> wallsByScan(const RadiusQuery& q) {
+    vector<WallNear> out;
+    for (int s = 0; s < (int)sectors.size(); s++) {
+        for (int w = 0; w < (int)sectors[s].walls.size(); w++) {
+            const Wall& wall = sectors[s].walls[w];
+            double dist = pointToSegmentDistance(q.x, q.y, wall.x1, wall.y1, wall.x2, wall.y2);
+            if (dist <= q.radius) out.push_back({ s, w, 0.0, 0.0, dist });
+        }
+    }
+    return out;
+}
+
+static bool sameWalls(vector<WallNear> a, vector<WallNear> b) {
+    if (a.size() != b.size()) return false;
+    auto byWall = [](const WallNear& x, const WallNear& y) { return x.sector < y.sector || (x.sector == y.sector && x.wall < y.wall); };
+    sort(a.begin(), a.end(), byWall);
+    sort(b.begin(), b.end(), byWall);
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].sector != b[i].sector || a[i].wall != b[i].wall || fabs(a[i].dist - b[i].dist) > 1e-9) return false;
+    }
+    return true;
+}
+
+static void testWallQueryMatchesScan() {
+    const char* maps[] = { "door.txt", "canal.txt" };
+    mt19937 rng(7);
+    uniform_real_distribution<double> coord(-1.0, 10.0), radius(0.1, 6.0);
+    for (const char* map : maps) {
+        loadMapFromFile(map);
+        bool same = true, sorted = true, closest = true;
+        vector<WallNear> near;
+        for (int k = 0; k < 500; k++) {
+            RadiusQuery q = { -1, coord(rng), coord(rng), 1.0, radius(rng), 0, false };
+            queryWallsInRadius(q, near);
+            if (!sameWalls(near, wallsByScan(q))) same = false;
+            for (size_t i = 0; i < near.size(); i++) {
+                if (i > 0 && near[i].dist < near[i - 1].dist) sorted = false;
+                if (fabs(hypot(near[i].closestX - q.x, near[i].closestY - q.y) - near[i].dist) > 1e-9) closest = false;
+            }
+        }
+        check(same, "wall query finds exactly the walls a full scan does");
+        check(sorted, "wall query is nearest first");
+        check(closest, "wall query distance is to its closest point");
+    }
+
+    // Shut door: the occluded query stays in room 0 and the door's own walls
+    loadMapFromFile("door.txt");
+    RadiusQuery q = { 0, 3.0, 2.0, 1.0, 8.0, 0, true };
+    vector<WallNear> near;
+    queryWallsInRadius(q, near);
+    bool farRoom = false;
+    for (const WallNear& n : near) farRoom = farRoom || n.sector == 2;
+    check(!near.empty() && !farRoom, "a shut door keeps the occluded wall query out of the far room");
+}
+
+static bool heard(int listener) {
+    bool alerted = (entities.flags[listener] & ENTITY_ALERTED) != 0;
+    entities.flags[listener] &= ~ENTITY_ALERTED;
+    return alerted;
+}
+
+// door.txt with the door open; noise triggers, heard by a monster in room 2
+static void testTriggers() {
+    loadMapFromFile("door.txt");
+    setSectorPlanes(1, 0.0, 4.0);
+    int listener = spawnEntity(8.0, 2.0, 0.2, ENTITY_MONSTER);
+    rebuildSectorBuckets();
+    posZ = 0.0;
+
+    // One step from room 0 to room 2 through the thin door sector
+    int enterDoor = addTrigger(TRIGGER_ENTER, 1, -1, TRIGGER_NOISE, 40, 0);
+    int crossOut = addTrigger(TRIGGER_CROSS, 1, 1, TRIGGER_NOISE, 40, 0);
+    buildTriggerIndex();
+    triggersPlayerMoved(3.9, 2.0, 5.2, 2.0);
+    check(triggers[enterDoor].spent, "a step through a thin sector fires its enter trigger");
+    check(triggers[crossOut].spent, "and the line out of it");
+    check(heard(listener), "the noise goes off");
+    triggersPlayerMoved(5.2, 2.0, 3.9, 2.0);
+    triggersPlayerMoved(3.9, 2.0, 5.2, 2.0);
+    check(!heard(listener), "once-only triggers stay spent");
+
+    // Cross line on room 0's side of the door, walked both ways
+    clearTriggers();
+    int line = addTrigger(TRIGGER_CROSS, 0, 1, TRIGGER_NOISE, 40, TRIGGER_REPEAT);
+    buildTriggerIndex();
+    triggersPlayerMoved(3.5, 2.0, 4.5, 2.0);
+    check(heard(listener), "a cross line fires walking out of its sector");
+    triggersPlayerMoved(4.5, 2.0, 3.5, 2.0);
+    check(heard(listener), "and walking back in");
+    check(!triggers[line].spent, "a repeatable trigger is never spent");
+
+    // Monsters only fire triggers flagged for them
+    clearTriggers();
+    int playerOnly = addTrigger(TRIGGER_ENTER, 1, -1, TRIGGER_NOISE, 40, 0);
+    int monsters = addTrigger(TRIGGER_ENTER, 1, -1, TRIGGER_NOISE, 40, TRIGGER_MONSTERS);
+    buildTriggerIndex();
+    int walker = spawnEntity(3.8, 2.0, 0.2, ENTITY_MONSTER);
+    entities.velX[walker] = 1.0;
+    updateEntities(0.5);
+    triggersEntitiesMoved();
+    check(entities.sector[walker] == 1, "the monster walks into the door");
+    check(!triggers[playerOnly].spent, "a player trigger ignores monsters");
+    check(triggers[monsters].spent, "a monster trigger fires for them");
+}
+
+static bool closeTo(double a, double b) {
+    return fabs(a - b) < 1e-9;
+}
+
+// There and back through a two-way link is the identity, and a point just
+// past one wall lands inside the other room
+static void checkRoundTrip(int sector, int wall, int targetSector, int targetWall, const char* what) {
+    const PortalLink& there = portalLinks[sectors[sector].walls[wall].link];
+    const PortalLink& back = portalLinks[sectors[targetSector].walls[targetWall].link];
+    const Wall& w = sectors[sector].walls[wall];
+    double mx = (w.x1 + w.x2) / 2, my = (w.y1 + w.y2) / 2;
+    double outX = -(w.y2 - w.y1), outY = w.x2 - w.x1;
+    if (getSectorForPosition(mx + outX * 0.01, my + outY * 0.01) == sector) {
+        outX = -outX;
+        outY = -outY;
+    }
+    double x = mx + outX * 0.01, y = my + outY * 0.01, dx = 0.6, dy = -0.8;
+    transformPoint(there.transform, x, y);
+    transformVector(there.transform, dx, dy);
+    bool lands = getSectorForPosition(x, y) == targetSector;
+    transformPoint(back.transform, x, y);
+    transformVector(back.transform, dx, dy);
+    check(lands && closeTo(x, mx + outX * 0.01) && closeTo(y, my + outY * 0.01) && closeTo(dx, 0.6) && closeTo(dy, -0.8), what);
+}
+
+// links.txt: room 0 links east to room 1 (same winding) and west to room
+// 2 (opposite winding), both ways; room 1's floor is 1
+static void testLinks() {
+    loadMapFromFile("links.txt");
+    check(portalLinks.size() == 4, "all four links load");
+    checkRoundTrip(0, 1, 1, 3, "round trip through a link between rooms of the same winding");
+    checkRoundTrip(0, 3, 2, 0, "round trip through a link between rooms of opposite winding");
+
+    // Reflection across room 0's south wall (y = 0)
+    int mirror = addMirror(0, 0);
+    check(mirror >= 0, "mirror on a plain wall");
+    const PortalTransform& m = portalLinks[mirror].transform;
+    double x = 1.0, y = 0.5, dx = 0.3, dy = -1.0, ox = 2.5, oy = 0.0;
+    transformPoint(m, x, y);
+    transformVector(m, dx, dy);
+    transformPoint(m, ox, oy);
+    check(closeTo(x, 1.0) && closeTo(y, -0.5) && closeTo(dx, 0.3) && closeTo(dy, 1.0), "a mirror reflects across its wall line");
+    check(closeTo(ox, 2.5) && closeTo(oy, 0.0), "points on the wall line stay put");
+
+    // Walking east into the link comes out of room 1's west wall, one step up
+    posX = 3.95;
+    posY = 2.0;
+    posZ = 0.0;
+    dirX = 1.0;
+    dirY = 0.0;
+    planeX = 0.0;
+    planeY = 0.66;
+    Uint32 passes = linkPasses;
+    check(passPortalLink(4.05, 2.0), "walking into a link passes it");
+    check(posX > 10.0 && posX < 10.1 && closeTo(posY, 2.0) && closeTo(posZ, 1.0) && closeTo(dirX, 1.0) && linkPasses == passes + 1,
+          "the player comes out the other side with their view and the floor step");
+
+    // Next to the far room's corner the exit is inside its south wall
+    setSectorPlanes(1, 2.0, 5.0);
+    posX = 3.95;
+    posY = 0.05;
+    posZ = 0.0;
+    check(passPortalLink(4.05, 0.05), "a blocked exit still uses up the step");
+    check(closeTo(posX, 3.95) && closeTo(posY, 0.05) && closeTo(posZ, 0.0) && linkPasses == passes + 1, "but leaves the player where they were");
+    posY = 2.0;
+    passPortalLink(4.05, 2.0);
+    check(closeTo(posZ, 2.0), "the floor step is taken as the floors are now");
+}
+
+// canal.txt: room 0 opens east onto a bridge deck 2 (4..8) over a
+// tunnel 1 (0..2), both on the same wall line
+static void testStackedOpenings() {
+    loadMapFromFile("canal.txt");
+    LosQuery low = { 0, 1.0, 2.0, 1.0, 1, 6.0, 2.0, 1.0 };
+    check(hasLineOfSight(low), "sight at tunnel height goes through the lower opening");
+    LosQuery high = { 0, 1.0, 2.0, 6.0, 2, 6.0, 2.0, 6.0 };
+    check(hasLineOfSight(high), "sight at deck height goes through the upper opening");
+    LosQuery between = { 0, 1.0, 2.0, 3.0, 2, 6.0, 2.0, 3.0 };
+    check(!hasLineOfSight(between), "sight across the solid band between them is blocked");
+
+    RayQuery ray = { 0, 1.0, 2.0, 1.0, 1.0, 0.0, 20.0, 0, -1 };
+    RayHit hit;
+    castRay(ray, hit);
+    check(hit.type == HIT_WALL && hit.sector == 1 && fabs(hit.dist - 7.0) < 1e-9, "a low shot runs down the tunnel");
+    ray.z = 3.0;
+    castRay(ray, hit);
+    check(hit.type == HIT_WALL && hit.sector == 0 && fabs(hit.dist - 3.0) < 1e-9, "a shot into the band hits the wall line");
+
+    // Same origin, so these go through the paired path
+    RayQuery pair[2] = { { 0, 1.0, 2.0, 1.0, 1.0, 0.1, 20.0, 0, -1 }, { 0, 1.0, 2.0, 1.0, 1.0, -0.1, 20.0, 0, -1 } };
+    RayHit hits[2];
+    castRays(pair, 2, hits);
+    check(hits[0].sector == 1 && hits[1].sector == 1, "paired low shots both run down the tunnel");
+
+    // Entities stand on the tunnel floor unless told otherwise
+    int inTunnel = spawnEntity(6.0, 2.0, 0.2, ENTITY_MONSTER);
+    int onDeck = spawnEntity(6.5, 2.0, 0.2, ENTITY_PICKUP, 4.0);
+    check(entities.sector[inTunnel] == 1, "an entity spawned under the deck is in the tunnel");
+    check(entities.sector[onDeck] == 2, "one spawned at deck height is on the deck");
+    double xs[2] = { 6.0, 6.5 }, ys[2] = { 2.0, 2.0 }, zs[2] = { -INFINITY, 4.0 }, radii[2] = { 0.2, 0.2 };
+    Uint32 flags[2] = { ENTITY_MONSTER, ENTITY_PICKUP };
+    spawnEntities(xs, ys, zs, radii, flags, 2);
+    int last = entities.count() - 1;
+    check(entities.sector[last - 1] == 1 && entities.sector[last] == 2, "batched spawns pick the same levels");
+
+    int walker = spawnEntity(3.0, 1.0, 0.2, ENTITY_MONSTER);
+    entities.velX[walker] = 1.0;
+    for (int t = 0; t < 30; t++) updateEntities(0.1);
+    check(entities.posX[walker] > 5.0 && entities.sector[walker] == 1, "a monster walking east off room 0's floor ends up in the tunnel");
+}
+
+int main() {
+    testFlowFieldDoorOpens();
+    testRadiusQueriesThroughDoor();
+    testWallQueryMatchesScan();
+    testTriggers();
+    testLinks();
+    testStackedOpenings();
+
+    if (failures > 0) {
+        cout << failures << " check(s) failed" << endl;
+        return 1;
+    }
+    cout << "All checks passed" << endl;
+    return 0;
+}
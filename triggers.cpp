@@ -0,0 +1,160 @@
+#include <iostream>
+#include <SDL2/SDL.h>
+#include <vector>
+#include <cmath>
+#include "helpers.h"
+#include "triggers.h"
+#include "entities.h"
+#include "movers.h"
+#include "polyobj.h"
+#include "noise.h"
+
+using namespace std;
+
+vector<Trigger> triggers;
+
+// Enter triggers of sector s: sectorTriggers[sectorStart[s] .. sectorStart[s + 1]).
+// Line triggers of wall w in sector s: wallTriggers[wallStart[wallBase[s] + w] .. wallStart[wallBase[s] + w + 1]),
+// so every line trigger of a sector is one contiguous run.
+static vector<int> sectorStart, sectorTriggers;
+static vector<int> wallBase, wallStart, wallTriggers;
+static int playerSector = -1; // as tracked by triggersPlayerMoved
+
+int addTrigger(int kind, int sector, int wall, int action, int target, Uint32 flags) {
+    if (kind < TRIGGER_ENTER || kind > TRIGGER_USE || action < TRIGGER_MOVER || action > TRIGGER_NOISE) return -1;
+    if (sector < 0 || sector >= (int)sectors.size()) return -1;
+    if (kind == TRIGGER_ENTER) wall = -1;
+    else if (wall < 0 || wall >= (int)sectors[sector].walls.size()) return -1;
+    if (kind == TRIGGER_CROSS && !sectors[sector].walls[wall].isPortal) return -1;
+
+    triggers.push_back({ kind, sector, wall, action, target, flags, false });
+    return (int)triggers.size() - 1;
+}
+
+void clearTriggers() {
+    triggers.clear();
+    sectorStart.clear();
+    sectorTriggers.clear();
+    wallBase.clear();
+    wallStart.clear();
+    wallTriggers.clear();
+    playerSector = -1;
+}
+
+void buildTriggerIndex() {
+    int sectorCount = (int)sectors.size();
+    wallBase.assign(sectorCount + 1, 0);
+    for (int s = 0; s < sectorCount; s++) wallBase[s + 1] = wallBase[s] + (int)sectors[s].walls.size();
+
+    // Counting sort, as for the entity buckets; cross triggers go on both sides of their portal
+    struct Entry {
+        int slot, trigger;
+    };
+    vector<Entry> sectorEntries, wallEntries;
+    for (int t = 0; t < (int)triggers.size(); t++) {
+        const Trigger& trigger = triggers[t];
+        if (trigger.kind == TRIGGER_ENTER) {
+            sectorEntries.push_back({ trigger.sector, t });
+            continue;
+        }
+        wallEntries.push_back({ wallBase[trigger.sector] + trigger.wall, t });
+        if (trigger.kind == TRIGGER_CROSS) {
+            int back = findBackWall(trigger.sector, trigger.wall);
+            int n = sectors[trigger.sector].walls[trigger.wall].adjoiningSector;
+            if (back >= 0) wallEntries.push_back({ wallBase[n] + back, t });
+        }
+    }
+
+    auto bucket = [](const vector<Entry>& entries, int slots, vector<int>& start, vector<int>& list) {
+        start.assign(slots + 1, 0);
+        for (const Entry& e : entries) start[e.slot + 1]++;
+        for (int i = 0; i < slots; i++) start[i + 1] += start[i];
+        list.resize(entries.size());
+        vector<int> fill(start.begin(), start.end() - 1);
+        for (const Entry& e : entries) list[fill[e.slot]++] = e.trigger;
+    };
+    bucket(sectorEntries, sectorCount, sectorStart, sectorTriggers);
+    bucket(wallEntries, wallBase[sectorCount], wallStart, wallTriggers);
+    playerSector = -1;
+}
+
+static bool fireTrigger(Trigger& trigger, bool monster, int sector, double x, double y) {
+    if (trigger.spent) return false;
+    if (monster && !(trigger.flags & TRIGGER_MONSTERS)) return false;
+
+    bool acted = false;
+    if (trigger.action == TRIGGER_MOVER) {
+        acted = activateMover(trigger.target);
+    } else if (trigger.action == TRIGGER_POLY) {
+        if (trigger.target >= 0 && trigger.target < (int)polyobjs.size()) {
+            const Polyobj& poly = polyobjs[trigger.target];
+            acted = activatePolyobj(poly.sector, poly.firstWall);
+        }
+    } else {
+        emitNoise(sector, x, y, trigger.target);
+        acted = true;
+    }
+    // A once-only trigger that found its target busy stays armed
+    if (acted && !(trigger.flags & TRIGGER_REPEAT)) trigger.spent = true;
+    return acted;
+}
+
+// Each portal a move went through, in order: line triggers on the wall
+// crossed, then enter triggers of the sector beyond. Actions happen where
+// the activator ended up.
+static void sectorsCrossed(bool monster, const SectorHop* hops, int hopCount, int sector, double x, double y) {
+    if (sectorStart.size() != sectors.size() + 1) return;
+
+    for (int h = 0; h < hopCount; h++) {
+        const SectorHop& hop = hops[h];
+        int slot = wallBase[hop.from] + hop.wall;
+        for (int k = wallStart[slot]; k < wallStart[slot + 1]; k++) {
+            Trigger& trigger = triggers[wallTriggers[k]];
+            if (trigger.kind == TRIGGER_CROSS) fireTrigger(trigger, monster, sector, x, y);
+        }
+        for (int k = sectorStart[hop.to]; k < sectorStart[hop.to + 1]; k++) {
+            fireTrigger(triggers[sectorTriggers[k]], monster, sector, x, y);
+        }
+    }
+}
+
+void triggersPlayerMoved(double oldX, double oldY, double newX, double newY) {
+    if (playerSector < 0) playerSector = getSectorForFeet(oldX, oldY, posZ);
+    if (oldX == newX && oldY == newY) return;
+
+    SectorHop hops[MAX_SECTOR_HOPS];
+    int hopCount = 0;
+    int to = updateSectorForMove(playerSector, oldX, oldY, newX, newY, feetProbeHeight(posZ), hops, &hopCount);
+    if (to < 0) {
+        // Lost track, e.g. after a jump; pick it up again without firing
+        playerSector = getSectorForFeet(newX, newY, posZ);
+        return;
+    }
+    sectorsCrossed(false, hops, hopCount, to, newX, newY);
+    playerSector = to;
+}
+
+void triggersPlayerTeleported() {
+    playerSector = getSectorForFeet(posX, posY, posZ);
+}
+
+void triggersEntitiesMoved() {
+    if (triggers.empty()) return;
+    for (const SectorCrossing& c : sectorCrossings) {
+        if (!(entities.flags[c.entity] & ENTITY_MONSTER)) continue;
+        sectorsCrossed(true, c.hops, c.hopCount, c.toSector, entities.posX[c.entity], entities.posY[c.entity]);
+    }
+}
+
+bool triggerUse(int sector, int wall) {
+    if (wallBase.size() != sectors.size() + 1 || sector < 0 || sector >= (int)sectors.size()) return false;
+    int slot = wallBase[sector] + wall;
+    if (wall < 0 || slot >= wallBase[sector + 1]) return false;
+
+    bool fired = false;
+    for (int k = wallStart[slot]; k < wallStart[slot + 1]; k++) {
+        Trigger& trigger = triggers[wallTriggers[k]];
+        if (trigger.kind == TRIGGER_USE && fireTrigger(trigger, false, sector, posX, posY)) fired = true;
+    }
+    return fired;
+}
@@ -0,0 +1,62 @@
+// triggers.h
+#ifndef TRIGGERS_H
+#define TRIGGERS_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+
+// Map line: trigger enter|cross|use sector wall mover|poly|noise target flags
+//   enter  fires when the activator arrives in the sector (wall ignored)
+//   cross  fires when the activator crosses the portal wall, either way
+//   use    fires when the player uses the wall
+//   mover  activates the mover in sector `target`
+//   poly   activates wall group number `target`, in map order
+//   noise  makes a noise of loudness `target` where the activator is
+// flags: 1 = fire every time instead of once, 2 = monsters fire it too
+enum TriggerKind {
+    TRIGGER_ENTER = 0,
+    TRIGGER_CROSS = 1,
+    TRIGGER_USE = 2,
+};
+
+enum TriggerAction {
+    TRIGGER_MOVER = 0,
+    TRIGGER_POLY = 1,
+    TRIGGER_NOISE = 2,
+};
+
+enum {
+    TRIGGER_REPEAT = 1 << 0,
+    TRIGGER_MONSTERS = 1 << 1,
+};
+
+struct Trigger {
+    int kind;
+    int sector, wall;
+    int action, target;
+    Uint32 flags;
+    bool spent;
+};
+
+extern std::vector<Trigger> triggers;
+
+// Returns the trigger id, or -1 if the sector or wall doesn't exist.
+int addTrigger(int kind, int sector, int wall, int action, int target, Uint32 flags);
+void clearTriggers();
+
+// Enter triggers are listed per sector and line triggers per wall, so
+// only the sectors and walls something actually moved through are looked
+// at. Build after the walls are final.
+void buildTriggerIndex();
+
+// The player's move for this tick. Call once per simulated tick.
+void triggersPlayerMoved(double oldX, double oldY, double newX, double newY);
+// Instead of that on a tick a link carried the player across the map:
+// picks up their new sector without firing anything.
+void triggersPlayerTeleported();
+// Walks the sectorCrossings the last updateEntities produced.
+void triggersEntitiesMoved();
+// True if a use trigger on the wall fired.
+bool triggerUse(int sector, int wall);
+
+#endif